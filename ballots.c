@@ -0,0 +1,334 @@
+#define _POSIX_C_SOURCE 200809L
+#include "ballots.h"
+#include "parallel.h"
+#include <string.h>
+#include <stdint.h>
+
+#define MAX_OCCUPANCY_RATIO 0.7
+#define DEFAULT_TABLE_SIZE 1024
+#define BATCH_IDS (1 << 20)
+#define BATCH_BALLOTS (1 << 16)
+
+static uint64_t mix64(uint64_t key){
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+static uint64_t pair_hash(size_t i, size_t j){
+  return mix64(((uint64_t)i * 0x9e3779b97f4a7c15ULL) ^ (uint64_t)j);
+}
+
+static uint64_t name_hash(const char *s, size_t length){
+  uint64_t h = 14695981039346656037ULL;
+  for(size_t i = 0; i < length; i++){
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static void pair_table_init(ballot_pair_table *pt){
+  pt->length = DEFAULT_TABLE_SIZE;
+  pt->occupancy = 0;
+  pt->entries = calloc(pt->length, sizeof(ballot_pair));
+}
+
+// Slots are empty when weight is zero. Every ballot contributes a strictly
+// positive weight, so a stored pair can never look empty.
+static ballot_pair *pair_table_lookup(ballot_pair_table *pt, size_t i, size_t j){
+  size_t mask = pt->length - 1;
+  size_t p = (size_t)(pair_hash(i, j) & mask);
+
+  for(;;){
+    ballot_pair *e = pt->entries + p;
+    if(e->weight == 0.0){
+      e->i = i;
+      e->j = j;
+      return e;
+    }
+    if(e->i == i && e->j == j) return e;
+    p = (p + 1) & mask;
+  }
+}
+
+static void pair_table_add(ballot_pair_table *pt, size_t i, size_t j, double weight){
+  if(pt->occupancy + 1 > pt->length * MAX_OCCUPANCY_RATIO){
+    size_t old_length = pt->length;
+    ballot_pair *old_entries = pt->entries;
+    pt->length *= 2;
+    pt->entries = calloc(pt->length, sizeof(ballot_pair));
+    for(size_t k = 0; k < old_length; k++){
+      if(old_entries[k].weight != 0.0){
+        *pair_table_lookup(pt, old_entries[k].i, old_entries[k].j) = old_entries[k];
+      }
+    }
+    free(old_entries);
+  }
+
+  ballot_pair *e = pair_table_lookup(pt, i, j);
+  if(e->weight == 0.0) pt->occupancy++;
+  e->weight += weight;
+}
+
+static size_t intern_name(ballot_aggregator *a, const char *name, size_t length){
+  ballot_name_table *nt = &a->name_table;
+
+  if(a->candidate_count + 1 > nt->length * MAX_OCCUPANCY_RATIO){
+    size_t old_length = nt->length;
+    size_t *old_ids = nt->ids;
+    nt->length *= 2;
+    nt->ids = malloc(nt->length * sizeof(size_t));
+    for(size_t k = 0; k < nt->length; k++) nt->ids[k] = SIZE_MAX;
+
+    size_t mask = nt->length - 1;
+    for(size_t k = 0; k < old_length; k++){
+      size_t id = old_ids[k];
+      if(id == SIZE_MAX) continue;
+      size_t p = (size_t)(name_hash(a->names[id], strlen(a->names[id])) & mask);
+      while(nt->ids[p] != SIZE_MAX) p = (p + 1) & mask;
+      nt->ids[p] = id;
+    }
+    free(old_ids);
+  }
+
+  size_t mask = nt->length - 1;
+  size_t p = (size_t)(name_hash(name, length) & mask);
+
+  for(;;){
+    size_t id = nt->ids[p];
+    if(id == SIZE_MAX) break;
+    if(!strncmp(a->names[id], name, length) && a->names[id][length] == '\0') return id;
+    p = (p + 1) & mask;
+  }
+
+  if(a->candidate_count == a->names_capacity){
+    a->names_capacity *= 2;
+    a->names = realloc(a->names, a->names_capacity * sizeof(char*));
+  }
+
+  size_t id = a->candidate_count++;
+  char *copy = malloc(length + 1);
+  memcpy(copy, name, length);
+  copy[length] = '\0';
+  a->names[id] = copy;
+  nt->ids[p] = id;
+  return id;
+}
+
+ballot_aggregator *ballot_aggregator_new(size_t shards){
+  if(!shards) shards = parallel_thread_count();
+
+  ballot_aggregator *a = calloc(1, sizeof(ballot_aggregator));
+
+  a->names_capacity = 64;
+  a->names = malloc(a->names_capacity * sizeof(char*));
+  a->name_table.length = DEFAULT_TABLE_SIZE;
+  a->name_table.ids = malloc(DEFAULT_TABLE_SIZE * sizeof(size_t));
+  for(size_t i = 0; i < DEFAULT_TABLE_SIZE; i++) a->name_table.ids[i] = SIZE_MAX;
+
+  a->ballot_offsets = malloc((BATCH_BALLOTS + 1) * sizeof(size_t));
+  a->ballot_ids = malloc(BATCH_IDS * sizeof(size_t));
+
+  a->shard_count = shards;
+  a->shards = malloc(shards * sizeof(ballot_pair_table));
+  for(size_t i = 0; i < shards; i++) pair_table_init(a->shards + i);
+
+  return a;
+}
+
+void ballot_aggregator_del(ballot_aggregator *a){
+  for(size_t i = 0; i < a->candidate_count; i++) free(a->names[i]);
+  free(a->names);
+  free(a->name_table.ids);
+  free(a->ballot_offsets);
+  free(a->ballot_ids);
+  for(size_t i = 0; i < a->shard_count; i++) free(a->shards[i].entries);
+  free(a->shards);
+  free(a);
+}
+
+typedef struct {
+  ballot_aggregator *aggregator;
+  size_t ballots_per_shard;
+} batch_job;
+
+static void accumulate_shard(void *context, size_t shard){
+  batch_job *job = context;
+  ballot_aggregator *a = job->aggregator;
+  ballot_pair_table *pt = a->shards + shard;
+
+  size_t start = shard * job->ballots_per_shard;
+  size_t end = start + job->ballots_per_shard;
+  if(end > a->pending_ballots) end = a->pending_ballots;
+
+  for(size_t b = start; b < end; b++){
+    size_t *vote = a->ballot_ids + a->ballot_offsets[b];
+    size_t n = a->ballot_offsets[b + 1] - a->ballot_offsets[b];
+    if(n < 2) continue;
+    double weight = 2.0 / (n * (n - 1));
+
+    for(size_t i = 0; i < n; i++){
+      for(size_t j = i + 1; j < n; j++){
+        pair_table_add(pt, vote[i], vote[j], weight);
+      }
+    }
+  }
+}
+
+static void flush_batch(ballot_aggregator *a){
+  if(!a->pending_ballots) return;
+
+  batch_job job;
+  job.aggregator = a;
+  job.ballots_per_shard = (a->pending_ballots + a->shard_count - 1) / a->shard_count;
+  parallel_for(a->shard_count, accumulate_shard, &job);
+
+  a->pending_ballots = 0;
+  a->pending_ids = 0;
+}
+
+// Splits like the old ruby script did: line.strip.split(/, */)
+void ballot_aggregator_add(ballot_aggregator *a, const char *line){
+  while(*line == ' ' || *line == '\t' || *line == '\n' || *line == '\r') line++;
+  size_t length = strlen(line);
+  while(length && (line[length-1] == ' ' || line[length-1] == '\t' ||
+                   line[length-1] == '\n' || line[length-1] == '\r')) length--;
+  if(!length) return;
+
+  // Trailing empty fields are dropped, so stop at the last non-comma
+  const char *end = line + length;
+  while(end > line && end[-1] == ',') end--;
+  if(end == line) return;
+
+  size_t fields = 1;
+  for(const char *c = line; c < end; c++) if(*c == ',') fields++;
+
+  if(fields > BATCH_IDS) {
+    fprintf(stderr, "Ballot with %lu entries is too long\n", (unsigned long)fields);
+    exit(1);
+  }
+  if(a->pending_ballots == BATCH_BALLOTS || a->pending_ids + fields > BATCH_IDS){
+    flush_batch(a);
+  }
+
+  a->ballot_offsets[a->pending_ballots] = a->pending_ids;
+
+  const char *start = line;
+  for(;;){
+    const char *comma = start;
+    while(comma < end && *comma != ',') comma++;
+    a->ballot_ids[a->pending_ids++] = intern_name(a, start, comma - start);
+    if(comma == end) break;
+    start = comma + 1;
+    while(start < end && *start == ' ') start++;
+  }
+
+  a->ballot_count++;
+  a->pending_ballots++;
+  a->ballot_offsets[a->pending_ballots] = a->pending_ids;
+}
+
+size_t ballot_aggregator_read(ballot_aggregator *a, FILE *f){
+  size_t before = a->ballot_count;
+  char *line = NULL;
+  size_t capacity = 0;
+
+  while(getline(&line, &capacity, f) != -1){
+    ballot_aggregator_add(a, line);
+  }
+
+  free(line);
+  return a->ballot_count - before;
+}
+
+void ballot_aggregator_finish(ballot_aggregator *a){
+  if(a->finished) return;
+  flush_batch(a);
+
+  ballot_pair_table *merged = a->shards;
+  for(size_t s = 1; s < a->shard_count; s++){
+    ballot_pair_table *pt = a->shards + s;
+    for(size_t k = 0; k < pt->length; k++){
+      ballot_pair *e = pt->entries + k;
+      if(e->weight != 0.0) pair_table_add(merged, e->i, e->j, e->weight);
+    }
+    free(pt->entries);
+    pt->entries = NULL;
+    pt->length = 0;
+    pt->occupancy = 0;
+  }
+
+  a->finished = 1;
+}
+
+size_t ballot_aggregator_pair_count(ballot_aggregator *a){
+  ballot_aggregator_finish(a);
+  return a->shards[0].occupancy;
+}
+
+static int compare_ballot_pairs(const void *xx, const void *yy){
+  const ballot_pair *x = xx;
+  const ballot_pair *y = yy;
+
+  if(x->i != y->i) return x->i < y->i ? -1 : 1;
+  if(x->j != y->j) return x->j < y->j ? -1 : 1;
+  return 0;
+}
+
+// Returns the observed pairs sorted by (i, j) so output is reproducible
+static ballot_pair *sorted_pairs(ballot_aggregator *a){
+  ballot_aggregator_finish(a);
+  ballot_pair_table *pt = a->shards;
+
+  ballot_pair *pairs = malloc((pt->occupancy + 1) * sizeof(ballot_pair));
+  size_t count = 0;
+  for(size_t k = 0; k < pt->length; k++){
+    if(pt->entries[k].weight != 0.0) pairs[count++] = pt->entries[k];
+  }
+  qsort(pairs, count, sizeof(ballot_pair), compare_ballot_pairs);
+  return pairs;
+}
+
+void ballot_aggregator_write_triples(ballot_aggregator *a, FILE *f){
+  ballot_pair *pairs = sorted_pairs(a);
+  size_t count = a->shards[0].occupancy;
+
+  fprintf(f, "%lu\n", (unsigned long)a->candidate_count);
+  for(size_t k = 0; k < count; k++){
+    fprintf(f, "%lu %lu %.17g\n", (unsigned long)pairs[k].i, (unsigned long)pairs[k].j, pairs[k].weight);
+  }
+
+  free(pairs);
+}
+
+void ballot_aggregator_write_binary(ballot_aggregator *a, FILE *f){
+  ballot_pair *pairs = sorted_pairs(a);
+  size_t count = a->shards[0].occupancy;
+
+  write_tournament_binary_header(f, a->candidate_count);
+  for(size_t k = 0; k < count; k++){
+    write_tournament_binary_entry(f, pairs[k].i, pairs[k].j, pairs[k].weight);
+  }
+
+  free(pairs);
+}
+
+void ballot_aggregator_write_candidates(ballot_aggregator *a, FILE *f){
+  for(size_t i = 0; i < a->candidate_count; i++) fprintf(f, "%s\n", a->names[i]);
+}
+
+tournament *ballot_aggregator_tournament(ballot_aggregator *a){
+  ballot_aggregator_finish(a);
+  ballot_pair_table *pt = a->shards;
+
+  tournament *t = new_tournament(a->candidate_count);
+  for(size_t k = 0; k < pt->length; k++){
+    ballot_pair *e = pt->entries + k;
+    if(e->weight != 0.0) tournament_set(t, e->i, e->j, e->weight);
+  }
+  return t;
+}
@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "fas_tournament.h"
+
+// Streaming aggregation of ranked ballots into a sparse tournament.
+//
+// Each ballot is a comma separated list of candidate names, most preferred
+// first. A ballot of length n contributes 2 / (n(n-1)) to W_ij for every i
+// ranked above j, so every ballot carries the same total weight. Names are
+// interned in order of first appearance, and only pairs that actually occur
+// in some ballot are ever stored.
+
+typedef struct {
+  size_t i;
+  size_t j;
+  double weight;
+} ballot_pair;
+
+typedef struct {
+  size_t length;
+  size_t occupancy;
+  ballot_pair *entries;
+} ballot_pair_table;
+
+typedef struct {
+  size_t length;
+  size_t occupancy;
+  size_t *ids;
+} ballot_name_table;
+
+typedef struct {
+  size_t candidate_count;
+  size_t names_capacity;
+  char **names;
+  ballot_name_table name_table;
+
+  size_t ballot_count;
+  size_t pending_ballots;
+  size_t pending_ids;
+  size_t *ballot_offsets;
+  size_t *ballot_ids;
+
+  size_t shard_count;
+  ballot_pair_table *shards;
+  int finished;
+} ballot_aggregator;
+
+ballot_aggregator *ballot_aggregator_new(size_t shards);
+void ballot_aggregator_del(ballot_aggregator *a);
+
+void ballot_aggregator_add(ballot_aggregator *a, const char *line);
+size_t ballot_aggregator_read(ballot_aggregator *a, FILE *f);
+void ballot_aggregator_finish(ballot_aggregator *a);
+
+size_t ballot_aggregator_pair_count(ballot_aggregator *a);
+void ballot_aggregator_write_triples(ballot_aggregator *a, FILE *f);
+void ballot_aggregator_write_binary(ballot_aggregator *a, FILE *f);
+void ballot_aggregator_write_candidates(ballot_aggregator *a, FILE *f);
+tournament *ballot_aggregator_tournament(ballot_aggregator *a);
@@ -0,0 +1,116 @@
+#include "beater_lists.h"
+
+beater_lists *beater_lists_new(margin_matrix *m, double accuracy, double max_fraction){
+  size_t n = m->size;
+  if(n >= UINT32_MAX) return NULL;
+
+  size_t *counts = calloc(n + 1, sizeof(size_t));
+  size_t limit = (size_t)(max_fraction * n * (n - 1) / 2);
+  size_t total = 0;
+
+  for(size_t lo = 0; lo < n; lo++){
+    for(size_t hi = lo + 1; hi < n; hi++){
+      double margin = margin_matrix_entry(m, lo, hi);
+      if(margin >= accuracy){
+        counts[hi]++;
+        total++;
+      } else if(margin <= -accuracy){
+        counts[lo]++;
+        total++;
+      }
+    }
+    if(total > limit){
+      free(counts);
+      return NULL;
+    }
+  }
+
+  beater_lists *b = malloc(sizeof(beater_lists));
+  b->size = n;
+  b->starts = malloc((n + 1) * sizeof(size_t));
+  b->items = malloc((total ? total : 1) * sizeof(uint32_t));
+  b->labels = calloc(n + 2, sizeof(uint64_t));
+  b->next = malloc((n + 2) * sizeof(size_t));
+
+  size_t start = 0;
+  for(size_t x = 0; x < n; x++){
+    b->starts[x] = start;
+    start += counts[x];
+    // Reused as the fill cursor
+    counts[x] = b->starts[x];
+  }
+  b->starts[n] = start;
+
+  for(size_t lo = 0; lo < n; lo++){
+    for(size_t hi = lo + 1; hi < n; hi++){
+      double margin = margin_matrix_entry(m, lo, hi);
+      if(margin >= accuracy){
+        b->items[counts[hi]++] = (uint32_t)lo;
+      } else if(margin <= -accuracy){
+        b->items[counts[lo]++] = (uint32_t)hi;
+      }
+    }
+  }
+
+  free(counts);
+  return b;
+}
+
+void beater_lists_del(beater_lists *b){
+  if(!b) return;
+  free(b->starts);
+  free(b->items);
+  free(b->labels);
+  free(b->next);
+  free(b);
+}
+
+static void relabel(beater_lists *b, size_t head, size_t count){
+  uint64_t gap = UINT64_MAX / (count + 2);
+  uint64_t label = gap;
+  for(size_t x = b->next[head]; x != head + 1; x = b->next[x]){
+    b->labels[x] = label;
+    label += gap;
+  }
+}
+
+int beater_lists_sort(beater_lists *b, size_t n, size_t *items){
+  size_t head = b->size;
+  size_t tail = b->size + 1;
+  uint64_t *labels = b->labels;
+  size_t *next = b->next;
+
+  labels[head] = 0;
+  labels[tail] = UINT64_MAX;
+  next[head] = tail;
+
+  for(size_t i = 0; i < n; i++){
+    size_t x = items[i];
+
+    // Items outside this ordering have label 0 and so never win
+    size_t after = head;
+    uint64_t latest = 0;
+    for(size_t k = b->starts[x]; k < b->starts[x + 1]; k++){
+      size_t y = b->items[k];
+      if(labels[y] > latest){
+        latest = labels[y];
+        after = y;
+      }
+    }
+
+    if(labels[next[after]] - labels[after] < 2) relabel(b, head, i);
+    labels[x] = labels[after] + (labels[next[after]] - labels[after]) / 2;
+    next[x] = next[after];
+    next[after] = x;
+  }
+
+  int changed = 0;
+  size_t k = 0;
+  for(size_t x = next[head]; x != tail; x = next[x]){
+    changed |= items[k] != x;
+    items[k++] = x;
+  }
+  for(size_t i = 0; i < n; i++) labels[items[i]] = 0;
+
+  return changed;
+}
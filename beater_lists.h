@@ -0,0 +1,36 @@
+#ifndef BEATER_LISTS_H
+#define BEATER_LISTS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "margin_matrix.h"
+
+// For each item, the items that strictly beat it, for running local_sort
+// on sparse tournaments without walking every item past every other.
+//
+// local_sort moves each item left until the item before it strictly beats
+// it, i.e. it goes straight after the last item so far that beats it. When
+// most pairs are tied that is usually a long way, but with the beaters of
+// an item to hand it is the beater with the latest position. Positions are
+// kept as labels on a linked list (an order maintenance list), spaced out
+// so that a new label fits between two neighbours until they run out, when
+// the whole list is relabelled.
+
+typedef struct {
+  size_t size;
+  size_t *starts;
+  uint32_t *items;
+  // Indexed by item, with size and size + 1 as the head and tail sentinels.
+  // Labels are 0 for items not in the list, and are cleared after each sort.
+  uint64_t *labels;
+  size_t *next;
+} beater_lists;
+
+// Returns NULL if more than max_fraction of pairs differ by at least
+// accuracy, since then the lists cost more than they save.
+beater_lists *beater_lists_new(margin_matrix *m, double accuracy, double max_fraction);
+void beater_lists_del(beater_lists *b);
+
+// Same result as the insertion sort in local_sort
+int beater_lists_sort(beater_lists *b, size_t n, size_t *items);
+#endif
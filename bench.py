@@ -0,0 +1,120 @@
+"""
+Scaling benchmark on synthetic tournaments.
+
+For each size and model a tournament is written by ./generate in the binary
+format and solved by ./fas. Reports the wall clock time and peak resident
+memory of the solve, and the solver's score as a fraction of the score of
+the planted ordering (which can be above 1 when noise makes something
+better than the planted ordering).
+
+The generator streams its output and runs at every size up to 10^6. The
+solver stores the tournament as a dense n x n matrix, 8 n^2 bytes of
+doubles, so above DENSE_LIMIT only the generation is timed and the solve
+columns are left blank.
+
+Usage: python bench.py [size ...]
+"""
+from __future__ import print_function
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+from time import time
+
+HERE = os.path.abspath(os.path.dirname(__file__))
+FAS = os.path.join(HERE, "fas")
+GENERATE = os.path.join(HERE, "generate")
+
+SIZES = [int(n) for n in sys.argv[1:]] or [
+    1000, 2000, 5000, 10000, 100000, 1000000
+]
+
+# Largest size handed to the solver: 800MB of matrix at 10^4, and 80GB at
+# 10^5
+DENSE_LIMIT = 10000
+
+# Weighted pairs per item for the pair models, so the number of records
+# grows linearly with the size
+DEGREE = 50
+
+
+def models(n):
+    density = str(min(1.0, float(DEGREE) / n))
+    return [
+        ("planted", ["-d", density, "-e", "0.1"]),
+        ("blocks", ["-d", density, "-e", "0.3", "-k", "10"]),
+        ("ties", ["-d", density, "-e", "0.1", "-t", "0.5"]),
+        ("mallows", ["-m", str(n), "-l", "10", "-p", "0.8"]),
+    ]
+
+
+def read_score(path):
+    with open(path) as f:
+        return float(re.search(r"Score: (\S+)", f.read()).group(1))
+
+
+def run(args, stdout):
+    """
+    Runs args to completion, returning wall clock seconds and peak RSS in
+    MB of that process alone.
+    """
+    start = time()
+    process = subprocess.Popen(args, stdout=stdout)
+    _, status, usage = os.wait4(process.pid, 0)
+    # Match Popen's convention of a negative returncode for a signal
+    if os.WIFSIGNALED(status):
+        process.returncode = -os.WTERMSIG(status)
+        raise RuntimeError(
+            "%s killed by signal %d" % (args[0], os.WTERMSIG(status))
+        )
+    process.returncode = os.WEXITSTATUS(status)
+    if process.returncode:
+        raise RuntimeError(
+            "%s exited with status %d" % (args[0], process.returncode)
+        )
+    # ru_maxrss is in kilobytes on Linux
+    return time() - start, usage.ru_maxrss / 1024.0
+
+
+def main():
+    workdir = tempfile.mkdtemp(prefix="fas-bench-")
+    data = os.path.join(workdir, "tournament.data")
+    planted = os.path.join(workdir, "planted.txt")
+    solved = os.path.join(workdir, "solved.txt")
+
+    print("%-8s %8s %12s %9s %9s %9s %8s" % (
+        "model", "n", "records", "gen (s)", "fas (s)", "rss (MB)", "quality"
+    ))
+    for n in SIZES:
+        for name, args in models(n):
+            with open(data, "wb") as out:
+                gen_time, _ = run(
+                    [GENERATE, "-b", "-s", str(n), "-o", planted] + args +
+                    [str(n)],
+                    out
+                )
+            records = (os.path.getsize(data) - 16) // 24
+            if n > DENSE_LIMIT:
+                print("%-8s %8d %12d %9.2f %9s %9s %8s" % (
+                    name, n, records, gen_time, "-", "-", "-"
+                ))
+                sys.stdout.flush()
+                continue
+            with open(solved, "w") as out:
+                fas_time, rss = run([FAS, data], out)
+            quality = read_score(solved) / read_score(planted)
+            print("%-8s %8d %12d %9.2f %9.2f %9.1f %8.4f" % (
+                name, n, records, gen_time, fas_time, rss, quality
+            ))
+            sys.stdout.flush()
+
+    for path in (data, planted, solved):
+        if os.path.exists(path):
+            os.remove(path)
+    os.rmdir(workdir)
+
+
+if __name__ == "__main__":
+    main()
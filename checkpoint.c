@@ -0,0 +1,286 @@
+#define _POSIX_C_SOURCE 200809L
+#include "checkpoint.h"
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+static char *_checkpoint_path = NULL;
+static double _checkpoint_interval = 0;
+static int _checkpoint_memo = 0;
+static double _last_checkpoint = 0;
+static volatile sig_atomic_t _terminate_requested = 0;
+static int _watch_depth = 0;
+static int _watching = 0;
+static struct sigaction _previous_action;
+static size_t *_component_ordering = NULL;
+static size_t _component_done = 0;
+
+static void fail(char *msg){
+  fprintf(stderr, "%s\n", msg);
+  exit(1);
+}
+
+static double monotonic_seconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void request_termination(int signal){
+  (void)signal;
+  _terminate_requested = 1;
+}
+
+void checkpoint_configure(const char *path, double interval, int save_memo){
+  free(_checkpoint_path);
+  _checkpoint_path = NULL;
+  if(!path) return;
+
+  _checkpoint_path = malloc(strlen(path) + 1);
+  strcpy(_checkpoint_path, path);
+  _checkpoint_interval = interval;
+  _checkpoint_memo = save_memo;
+  _last_checkpoint = monotonic_seconds();
+}
+
+void checkpoint_begin(){
+  if(_watch_depth++ || !_checkpoint_path) return;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = request_termination;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGTERM, &action, &_previous_action);
+  _watching = 1;
+}
+
+void checkpoint_end(){
+  if(--_watch_depth || !_watching) return;
+
+  sigaction(SIGTERM, &_previous_action, NULL);
+  _watching = 0;
+  if(_terminate_requested) raise(SIGTERM);
+}
+
+int checkpoint_terminating(){
+  return _watching && _terminate_requested;
+}
+
+void checkpoint_component(size_t *ordering, size_t done){
+  _component_ordering = ordering;
+  _component_done = done;
+}
+
+void checkpoint_if_due(fas_optimiser *o,
+                       checkpoint_phase phase,
+                       size_t generations,
+                       size_t n,
+                       size_t *ordering,
+                       population *p){
+  if(!_checkpoint_path) return;
+
+  // Passes run on a slice of the tournament can't be resumed from, unless
+  // it is the component a split run is working on
+  size_t size = o->tournament->size;
+  int component = _component_ordering && ordering == _component_ordering + _component_done;
+  if(!component && n != size) return;
+
+  double now = monotonic_seconds();
+  if(!_terminate_requested && now - _last_checkpoint < _checkpoint_interval) return;
+
+  checkpoint c;
+  c.size = size;
+  c.total_weight = o->margins->total_weight;
+  if(component){
+    // A component is resumed from its start, unless it is finished
+    c.phase = CHECKPOINT_SPLIT;
+    c.generations = 0;
+    c.done = _component_done + (phase == CHECKPOINT_DONE ? n : 0);
+    c.ordering = _component_ordering;
+    c.population = NULL;
+  } else {
+    c.phase = phase;
+    c.generations = generations;
+    c.done = 0;
+    c.ordering = ordering;
+    c.population = p;
+  }
+  c.score = score_fas_tournament(o->tournament, size, c.ordering);
+  c.rng = o->rng;
+  c.memo = _checkpoint_memo ? o->opt_table : NULL;
+
+  checkpoint_write(_checkpoint_path, &c);
+  _last_checkpoint = monotonic_seconds();
+  FASDEBUG("Checkpointed phase %d to %s\n", (int)c.phase, _checkpoint_path);
+
+  if(_terminate_requested){
+    signal(SIGTERM, SIG_DFL);
+    raise(SIGTERM);
+  }
+}
+
+static void write_u64(FILE *f, uint64_t x){
+  fwrite(&x, sizeof(uint64_t), 1, f);
+}
+
+static void write_double(FILE *f, double x){
+  fwrite(&x, sizeof(double), 1, f);
+}
+
+static void write_items(FILE *f, size_t n, size_t *items){
+  for(size_t i = 0; i < n; i++) write_u64(f, items[i]);
+}
+
+static uint64_t read_u64(FILE *f){
+  uint64_t x;
+  if(fread(&x, sizeof(uint64_t), 1, f) != 1) fail("Truncated checkpoint");
+  return x;
+}
+
+static double read_double(FILE *f){
+  double x;
+  if(fread(&x, sizeof(double), 1, f) != 1) fail("Truncated checkpoint");
+  return x;
+}
+
+static void read_items(FILE *f, size_t bound, size_t n, size_t *items){
+  for(size_t i = 0; i < n; i++){
+    uint64_t x = read_u64(f);
+    if(x >= bound) fail("Checkpoint item out of bounds");
+    items[i] = x;
+  }
+}
+
+// Written to a temporary file and renamed into place, so a checkpoint
+// interrupted half way never replaces a good one
+void checkpoint_write(const char *path, checkpoint *c){
+  size_t length = strlen(path);
+  char *temporary = malloc(length + 5);
+  memcpy(temporary, path, length);
+  strcpy(temporary + length, ".tmp");
+
+  FILE *f = fopen(temporary, "wb");
+  if(!f){
+    fprintf(stderr, "Could not open %s for writing\n", temporary);
+    exit(1);
+  }
+
+  uint32_t version = CHECKPOINT_VERSION;
+  fwrite(CHECKPOINT_MAGIC, 1, strlen(CHECKPOINT_MAGIC), f);
+  fwrite(&version, sizeof(uint32_t), 1, f);
+
+  write_u64(f, c->size);
+  write_double(f, c->total_weight);
+  write_u64(f, c->phase);
+  write_u64(f, c->generations);
+  write_u64(f, c->done);
+  write_double(f, c->score);
+  write_items(f, c->size, c->ordering);
+  write_u64(f, c->rng.state);
+
+  if(c->population){
+    population *p = c->population;
+    write_u64(f, p->population_count);
+    write_u64(f, p->members_size);
+    for(size_t i = 0; i < p->population_count; i++){
+      write_double(f, p->members[i].score);
+      write_items(f, p->members_size, p->members[i].data);
+    }
+  } else {
+    write_u64(f, 0);
+  }
+
+  if(c->memo){
+    optimisation_table *ot = c->memo;
+    uint64_t count = 0;
+    for(size_t i = 0; i < ot->length; i++){
+      if(ot->entries[i].length && ot->entries[i].value != OT_UNKNOWN) count++;
+    }
+    write_u64(f, count);
+    for(size_t i = 0; i < ot->length; i++){
+      ot_entry *e = ot->entries + i;
+      if(!e->length || e->value == OT_UNKNOWN) continue;
+      write_u64(f, e->length);
+      write_double(f, e->value);
+      write_items(f, e->length, e->data);
+    }
+  } else {
+    write_u64(f, 0);
+  }
+
+  if(fclose(f) || rename(temporary, path)){
+    fprintf(stderr, "Could not write checkpoint to %s\n", path);
+    exit(1);
+  }
+  free(temporary);
+}
+
+checkpoint *checkpoint_read(const char *path){
+  FILE *f = fopen(path, "rb");
+  if(!f){
+    fprintf(stderr, "Could not open %s\n", path);
+    exit(1);
+  }
+
+  char magic[sizeof(CHECKPOINT_MAGIC)];
+  size_t magic_length = strlen(CHECKPOINT_MAGIC);
+  uint32_t version;
+  if(fread(magic, 1, magic_length, f) != magic_length ||
+     memcmp(magic, CHECKPOINT_MAGIC, magic_length)){
+    fail("Bad magic for checkpoint");
+  }
+  if(fread(&version, sizeof(uint32_t), 1, f) != 1 || version != CHECKPOINT_VERSION){
+    fail("Unsupported checkpoint version");
+  }
+
+  checkpoint *c = calloc(1, sizeof(checkpoint));
+  c->size = read_u64(f);
+  c->total_weight = read_double(f);
+  uint64_t phase = read_u64(f);
+  if(phase > CHECKPOINT_SPLIT) fail("Bad phase in checkpoint");
+  c->phase = (checkpoint_phase)phase;
+  c->generations = read_u64(f);
+  c->done = read_u64(f);
+  if(c->done > c->size) fail("Bad split position in checkpoint");
+  c->score = read_double(f);
+  c->ordering = malloc(c->size * sizeof(size_t));
+  read_items(f, c->size, c->size, c->ordering);
+  c->rng.state = read_u64(f);
+
+  uint64_t population_count = read_u64(f);
+  if(population_count){
+    size_t members_size = read_u64(f);
+    if(members_size != c->size) fail("Bad population in checkpoint");
+    population *p = population_new(population_count, members_size);
+    for(size_t i = 0; i < population_count; i++){
+      p->members[i].score = read_double(f);
+      read_items(f, c->size, members_size, p->members[i].data);
+    }
+    c->population = p;
+  }
+
+  uint64_t memo_count = read_u64(f);
+  if(memo_count){
+    optimisation_table *ot = optimisation_table_new();
+    size_t *data = malloc(c->size * sizeof(size_t));
+    for(uint64_t k = 0; k < memo_count; k++){
+      size_t length = read_u64(f);
+      if(!length || length > c->size) fail("Bad memo entry in checkpoint");
+      double value = read_double(f);
+      read_items(f, c->size, length, data);
+      optimisation_table_lookup(ot, length, data)->value = value;
+    }
+    free(data);
+    c->memo = ot;
+  }
+
+  fclose(f);
+  return c;
+}
+
+void checkpoint_del(checkpoint *c){
+  free(c->ordering);
+  if(c->population) population_del(c->population);
+  if(c->memo) optimisation_table_del(c->memo);
+  free(c);
+}
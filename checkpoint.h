@@ -0,0 +1,80 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "fas_optimiser.h"
+
+// Checkpoints of the standard optimal_ordering pipeline, so that a long
+// solve can be stopped and picked up again later.
+//
+// The file starts with CHECKPOINT_MAGIC and a uint32_t version, followed
+// by uint64_t / double fields in host byte order: the tournament size and
+// total weight (to catch resuming against the wrong tournament), the phase
+// to run next, how many population generations have been run, how many
+// leading items a split run has finished, the score and ordering of the
+// best solution so far, the random state, the population if we are part
+// way through the population phase, and optionally the memo table of
+// table_optimise.
+#define CHECKPOINT_MAGIC "FASCHKPT"
+#define CHECKPOINT_VERSION 2
+
+typedef enum {
+  CHECKPOINT_POPULATION,
+  CHECKPOINT_SMOOTHING,
+  CHECKPOINT_WINDOW,
+  CHECKPOINT_SORT,
+  CHECKPOINT_DONE,
+  // A split run, to carry on from the component starting at done
+  CHECKPOINT_SPLIT
+} checkpoint_phase;
+
+typedef struct {
+  size_t size;
+  double total_weight;
+  checkpoint_phase phase;
+  size_t generations;
+  size_t done;
+  double score;
+  size_t *ordering;
+  random_state rng;
+  population *population;
+  optimisation_table *memo;
+} checkpoint;
+
+// Checkpoints are written to path every interval seconds, and when the
+// process gets SIGTERM, at the next point where the solver state is
+// consistent. After that checkpoint the SIGTERM is delivered as normal.
+void checkpoint_configure(const char *path, double interval, int save_memo);
+
+// SIGTERM is only held back between these, around work that calls
+// checkpoint_if_due. If one arrived and no checkpoint was taken for it,
+// checkpoint_end delivers it.
+void checkpoint_begin();
+void checkpoint_end();
+
+// Whether a SIGTERM is waiting on the next checkpoint. Long passes check
+// this and stop early, leaving a consistent ordering, so that it comes
+// soon.
+int checkpoint_terminating();
+
+// While a split run works on the component at offset done of ordering,
+// checkpoint_if_due on that component saves the whole ordering as a
+// CHECKPOINT_SPLIT, to be resumed from the start of the component. NULL
+// goes back to checkpointing whole tournaments only.
+void checkpoint_component(size_t *ordering, size_t done);
+
+// Called by the pipeline between units of work. Writes a checkpoint if one
+// is due, and doesn't return if we have been asked to terminate.
+void checkpoint_if_due(fas_optimiser *o,
+                       checkpoint_phase phase,
+                       size_t generations,
+                       size_t n,
+                       size_t *ordering,
+                       population *p);
+
+void checkpoint_write(const char *path, checkpoint *c);
+checkpoint *checkpoint_read(const char *path);
+void checkpoint_del(checkpoint *c);
+
+// Carries on the optimal_ordering pipeline from where c left off
+size_t *resume_ordering(tournament *t, checkpoint *c);
+#endif
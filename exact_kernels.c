@@ -0,0 +1,114 @@
+#include "exact_kernels.h"
+#include <pthread.h>
+#include <math.h>
+
+// f[S] is the best margin sum over orderings that put the set S first, and
+//
+//   f[S] = max over v in S of f[S - v] + sum_{u not in S} M[v][u]
+//
+// since placing v last in S puts it ahead of everything outside S. The
+// sums over complements are read from two tables covering the low and high
+// halves of the bits, which keeps them small enough to stay in L1.
+//
+// Each size gets its own copy of the body with k a constant, so the
+// compiler can unroll the fixed-length loops and size the stack arrays.
+
+static inline __attribute__((always_inline))
+void exact_order(const size_t k, margin_matrix *m, const size_t *items, size_t *best,
+                 double *w, double *low, double *high, double *f, unsigned char *last){
+  const size_t low_bits = (k + 1) / 2;
+  const size_t high_bits = k - low_bits;
+  const size_t full = ((size_t)1 << k) - 1;
+
+  for(size_t v = 0; v < k; v++){
+    for(size_t u = 0; u < k; u++){
+      w[v * k + u] = v == u ? 0 : margin_matrix_get(m, items[v], items[u]);
+    }
+  }
+
+  for(size_t v = 0; v < k; v++){
+    double *l = low + (v << low_bits);
+    double *h = high + (v << high_bits);
+    l[0] = 0;
+    for(size_t c = 1; c < ((size_t)1 << low_bits); c++){
+      l[c] = l[c & (c - 1)] + w[v * k + __builtin_ctzl(c)];
+    }
+    h[0] = 0;
+    for(size_t c = 1; c < ((size_t)1 << high_bits); c++){
+      h[c] = h[c & (c - 1)] + w[v * k + low_bits + __builtin_ctzl(c)];
+    }
+  }
+
+  f[0] = 0;
+  for(size_t s = 1; s <= full; s++){
+    size_t complement = full & ~s;
+    size_t complement_low = complement & (((size_t)1 << low_bits) - 1);
+    size_t complement_high = complement >> low_bits;
+    double best_value = -HUGE_VAL;
+    unsigned char best_last = 0;
+
+    for(size_t rest = s; rest; rest &= rest - 1){
+      size_t v = __builtin_ctzl(rest);
+      double value = f[s & ~((size_t)1 << v)] +
+                     low[(v << low_bits) + complement_low] +
+                     high[(v << high_bits) + complement_high];
+      if(value > best_value){
+        best_value = value;
+        best_last = (unsigned char)v;
+      }
+    }
+
+    f[s] = best_value;
+    last[s] = best_last;
+  }
+
+  size_t s = full;
+  for(size_t p = k; p > 0; p--){
+    size_t v = last[s];
+    best[p - 1] = items[v];
+    s &= ~((size_t)1 << v);
+  }
+}
+
+#define DEFINE_EXACT_KERNEL(K) \
+  static void exact_kernel_##K(margin_matrix *m, const size_t *items, size_t *best){ \
+    double w[K * K]; \
+    double low[K << ((K + 1) / 2)]; \
+    double high[K << (K / 2)]; \
+    double f[1 << K]; \
+    unsigned char last[1 << K]; \
+    exact_order(K, m, items, best, w, low, high, f, last); \
+  }
+
+DEFINE_EXACT_KERNEL(7)
+DEFINE_EXACT_KERNEL(10)
+DEFINE_EXACT_KERNEL(11)
+DEFINE_EXACT_KERNEL(12)
+DEFINE_EXACT_KERNEL(13)
+
+static int _exact_kernels_enabled = 1;
+static pthread_once_t exact_kernels_checked = PTHREAD_ONCE_INIT;
+
+static void check_exact_kernels(){
+  const char *setting = getenv("FAS_EXACT_KERNELS");
+  if(setting && !strcmp(setting, "0")) _exact_kernels_enabled = 0;
+}
+
+void set_exact_kernels_enabled(int enabled){
+  pthread_once(&exact_kernels_checked, check_exact_kernels);
+  _exact_kernels_enabled = enabled;
+}
+
+exact_kernel exact_kernel_for(size_t n){
+  pthread_once(&exact_kernels_checked, check_exact_kernels);
+  if(!_exact_kernels_enabled) return NULL;
+
+  switch(n){
+    case 7: return exact_kernel_7;
+    case 10: return exact_kernel_10;
+    case 11: return exact_kernel_11;
+    case 12: return exact_kernel_12;
+    case 13: return exact_kernel_13;
+    default: return NULL;
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef EXACT_KERNELS_H
+#define EXACT_KERNELS_H
+
+#include "margin_matrix.h"
+
+// Exact orderings of small windows by dynamic programming over subsets,
+// specialised for the window sizes the optimiser actually uses.
+//
+// A kernel writes an optimal ordering of items[0..k) into best. It gathers
+// the k x k margins once, so after that nothing touches the full matrix.
+
+typedef void (*exact_kernel)(margin_matrix *m, const size_t *items, size_t *best);
+
+// The kernel for windows of n items, or NULL if there isn't one (or
+// FAS_EXACT_KERNELS=0, which is there for benchmarking the generic path)
+exact_kernel exact_kernel_for(size_t n);
+
+// Overrides FAS_EXACT_KERNELS, so the tests can compare both paths in one
+// process
+void set_exact_kernels_enabled(int enabled);
+#endif
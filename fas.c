@@ -1,39 +1,86 @@
 #include <time.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "fas_tournament.h"
+#include "checkpoint.h"
+#include "shard.h"
+#include "planner.h"
 
-int main(int argc, char **argv){
-  srand(time(NULL) ^ getpid());
+static void usage(){
+  fprintf(stderr, "Usage: fas [--precision double|float|fixed16] [--previous orderingfile [--deltas deltafile] | --portfolio seconds | --top k | --resume file | --shards count] [--checkpoint file [--checkpoint-interval seconds] [--checkpoint-memo]] [--plan key=value,...] [inputfile]\n");
+  exit(1);
+}
 
-  enable_fas_tournament_debug(getenv("DEBUG") != NULL);
+static FILE *open_or_die(char *path, char *mode){
+  FILE *f = fopen(path, mode);
+  if(!f){
+    fprintf(stderr, "Unable to open file %s\n", path);
+    exit(1);
+  }
+  return f;
+}
 
-  FILE *argf = NULL;
+// Reads every whole number in the file, skipping anything else. This means
+// the output of a previous run can be passed straight back in: brackets and
+// || markers are ignored, as is the score because it has a decimal point.
+static size_t *read_ordering(char *path, size_t *count){
+  FILE *f = open_or_die(path, "r");
+  size_t capacity = 1024;
+  size_t *items = malloc(sizeof(size_t) * capacity);
+  char token[64];
+  *count = 0;
 
-  if(argc > 1){
-    if(argc > 2){
-      fprintf(stderr, "Usage: fas [inputfile]\n");
-      exit(1);
-    }
+  while(fscanf(f, "%63s", token) == 1){
+    char *start = token;
+    char *end = token + strlen(token);
+    while(*start == '[') start++;
+    while(end > start && end[-1] == ']') end--;
+    if(start == end || strspn(start, "0123456789") != (size_t)(end - start)) continue;
 
-    argf = fopen(argv[1], "r");
-    if(!argf){
-      fprintf(stderr, "Unable to open file %s for reading\n", argv[1]);
-      exit(1);
+    if(*count == capacity){
+      capacity *= 2;
+      items = realloc(items, sizeof(size_t) * capacity);
     }
-  } else {
-    argf = stdin;
+    items[(*count)++] = strtoul(start, NULL, 10);
   }
 
-  tournament *t = read_tournament(argf);
+  fclose(f);
+  return items;
+}
 
-  size_t n = t->size;
-  size_t *items = optimal_ordering(t, NULL);
+// Deltas are lines of "i j x", the same as the body of a tournament file
+// except that x may be negative.
+static tournament_delta *read_deltas(char *path, size_t *count){
+  FILE *f = open_or_die(path, "r");
+  size_t capacity = 1024;
+  tournament_delta *deltas = malloc(sizeof(tournament_delta) * capacity);
+  unsigned long i, j;
+  double x;
+  *count = 0;
 
-  printf("Score: %f\n", score_fas_tournament(t, n, items));
-  printf("Optimal ordering:");
+  while(fscanf(f, "%lu %lu %lf", &i, &j, &x) == 3){
+    if(*count == capacity){
+      capacity *= 2;
+      deltas = realloc(deltas, sizeof(tournament_delta) * capacity);
+    }
+    deltas[*count].i = i;
+    deltas[*count].j = j;
+    deltas[*count].delta = x;
+    (*count)++;
+  }
 
+  if(!feof(f)){
+    fprintf(stderr, "Failed to parse deltas in %s\n", path);
+    exit(1);
+  }
+
+  fclose(f);
+  return deltas;
+}
+
+static void print_ordering(tournament *t, size_t n, size_t *items){
   size_t i = 0;
   size_t next_boundary = condorcet_boundary_from(t, n, items, i);
 
@@ -60,6 +107,151 @@ int main(int argc, char **argv){
     }
   }
   printf("\n");
+}
+
+int main(int argc, char **argv){
+  srand(time(NULL) ^ getpid());
+
+  enable_fas_tournament_debug(getenv("DEBUG") != NULL);
+
+  FILE *argf = NULL;
+  char *input_file = NULL;
+  char *previous_file = NULL;
+  char *deltas_file = NULL;
+  tournament_precision precision = TOURNAMENT_DOUBLE;
+  double portfolio_seconds = 0;
+  size_t top_k = 0;
+  char *checkpoint_file = NULL;
+  char *resume_file = NULL;
+  double checkpoint_interval = 60;
+  int checkpoint_memo = 0;
+  size_t shards = 0;
+  int worker = 0;
+
+  for(int i = 1; i < argc; i++){
+    if(!strcmp(argv[i], "--precision")){
+      if(++i >= argc || !parse_tournament_precision(argv[i], &precision)) usage();
+    } else if(!strcmp(argv[i], "--previous")){
+      if(++i >= argc) usage();
+      previous_file = argv[i];
+    } else if(!strcmp(argv[i], "--deltas")){
+      if(++i >= argc) usage();
+      deltas_file = argv[i];
+    } else if(!strcmp(argv[i], "--portfolio")){
+      if(++i >= argc) usage();
+      portfolio_seconds = strtod(argv[i], NULL);
+      if(portfolio_seconds <= 0) usage();
+    } else if(!strcmp(argv[i], "--top")){
+      if(++i >= argc) usage();
+      top_k = strtoul(argv[i], NULL, 10);
+      if(!top_k) usage();
+    } else if(!strcmp(argv[i], "--checkpoint")){
+      if(++i >= argc) usage();
+      checkpoint_file = argv[i];
+    } else if(!strcmp(argv[i], "--checkpoint-interval")){
+      if(++i >= argc) usage();
+      checkpoint_interval = strtod(argv[i], NULL);
+    } else if(!strcmp(argv[i], "--checkpoint-memo")){
+      checkpoint_memo = 1;
+    } else if(!strcmp(argv[i], "--resume")){
+      if(++i >= argc) usage();
+      resume_file = argv[i];
+    } else if(!strcmp(argv[i], "--shards")){
+      if(++i >= argc) usage();
+      shards = strtoul(argv[i], NULL, 10);
+      if(!shards) usage();
+    } else if(!strcmp(argv[i], "--plan")){
+      if(++i >= argc || !set_plan_overrides(argv[i])) usage();
+    } else if(!strcmp(argv[i], "--worker")){
+      // Internal: the other end of --shards
+      worker = 1;
+    } else if(argv[i][0] == '-' || input_file){
+      usage();
+    } else {
+      input_file = argv[i];
+    }
+  }
+
+  if(worker){
+    run_shard_worker(stdin, stdout, precision);
+    return 0;
+  }
+
+  if(deltas_file && !previous_file) usage();
+  // fixed16 entries would clamp at the largest value the scale allows
+  if(deltas_file && precision == TOURNAMENT_FIXED16) usage();
+
+  // Each of these picks a different way of producing the ordering
+  int modes = (previous_file != NULL) + (resume_file != NULL) + (shards > 0) + (top_k > 0) + (portfolio_seconds > 0);
+  if(modes > 1) usage();
+  // Only the default pipeline can be checkpointed
+  if(checkpoint_file && modes && !resume_file) usage();
+
+  // A resumed run carries on checkpointing to the same file by default
+  if(resume_file && !checkpoint_file) checkpoint_file = resume_file;
+  if(checkpoint_file) checkpoint_configure(checkpoint_file, checkpoint_interval, checkpoint_memo);
+
+  if(input_file){
+    argf = open_or_die(input_file, "r");
+  } else {
+    argf = stdin;
+  }
+
+  tournament *t = read_tournament(argf);
+
+  if(precision != TOURNAMENT_DOUBLE){
+    tournament *ct = convert_tournament(t, precision);
+    del_tournament(t);
+    t = ct;
+  }
+
+  size_t *items;
+
+  if(previous_file){
+    size_t previous_count = 0;
+    size_t delta_count = 0;
+    size_t *previous = read_ordering(previous_file, &previous_count);
+    tournament_delta *deltas = deltas_file ? read_deltas(deltas_file, &delta_count) : NULL;
+
+    // Deltas may mention new items, which grows the tournament
+    size_t needed = t->size;
+    for(size_t k = 0; k < delta_count; k++){
+      if(deltas[k].i >= needed) needed = deltas[k].i + 1;
+      if(deltas[k].j >= needed) needed = deltas[k].j + 1;
+    }
+    if(needed > t->size){
+      tournament *rt = resize_tournament(t, needed);
+      del_tournament(t);
+      t = rt;
+    }
+
+    items = reoptimise_ordering(t, delta_count, deltas, previous_count, previous);
+    free(previous);
+    free(deltas);
+  } else if(resume_file){
+    checkpoint *c = checkpoint_read(resume_file);
+    items = resume_ordering(t, c);
+    checkpoint_del(c);
+  } else if(shards){
+    items = sharded_ordering(t, shards, "/proc/self/exe");
+  } else if(top_k){
+    items = top_k_ordering(t, NULL, top_k, NULL);
+  } else if(portfolio_seconds > 0){
+    items = portfolio_ordering(t, NULL, portfolio_seconds);
+  } else {
+    items = optimal_ordering(t, NULL);
+  }
+
+  if(top_k){
+    if(top_k > t->size) top_k = t->size;
+    printf("Score: %f\n", score_fas_tournament(t, top_k, items));
+    printf("Top %lu ordering:", (unsigned long)top_k);
+    print_ordering(t, top_k, items);
+  } else {
+    printf("Score: %f\n", score_fas_tournament(t, t->size, items));
+    printf("Optimal ordering:");
+    print_ordering(t, t->size, items);
+  }
 
   free(items);
   del_tournament(t);
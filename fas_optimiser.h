@@ -0,0 +1,76 @@
+#ifndef FAS_OPTIMISER_H
+#define FAS_OPTIMISER_H
+
+#include "fas_tournament.h"
+#include "optimisation_table.h"
+#include "margin_matrix.h"
+#include "population.h"
+#include "permutations.h"
+#include "shared_table.h"
+#include "scratch_arena.h"
+#include "beater_lists.h"
+
+// Pairs whose weights differ by less than this are treated as tied
+#define ACCURACY 0.001
+
+extern int _enable_fas_tournament_debug;
+#define FASDEBUG(...) if(_enable_fas_tournament_debug) fprintf(stderr, __VA_ARGS__);
+
+typedef struct {
+  size_t *buffer;
+  optimisation_table *opt_table;
+  tournament *tournament;
+  margin_matrix *margins;
+  int owns_margins;
+  random_state rng;
+  // When set, table_optimise memoises here instead of in opt_table
+  shared_optimisation_table *shared_table;
+  scratch_arena *scratch;
+  // Built by the first local_sort that could use them, and left NULL if the
+  // tournament is too dense for them to pay
+  beater_lists *beaters;
+  int beaters_checked;
+  // CLOCK_MONOTONIC seconds after which long passes stop early, or 0
+  double deadline;
+} fas_optimiser;
+
+fas_optimiser *new_optimiser(tournament *t);
+fas_optimiser *new_optimiser_sharing(fas_optimiser *parent, uint64_t seed);
+void del_optimiser(fas_optimiser *o);
+void reset_optimiser(fas_optimiser *opt);
+
+size_t *integer_range(size_t n);
+
+// Whether long passes should stop early, leaving a consistent ordering,
+// because a SIGTERM is waiting on a checkpoint or o's deadline has passed
+int optimiser_stopping(fas_optimiser *o);
+
+int table_optimise(fas_optimiser *o, size_t n, size_t *items);
+int window_optimise(fas_optimiser *o, size_t n, size_t *items, size_t window);
+int stride_optimise(fas_optimiser *o, size_t n, size_t *data, size_t stride);
+int single_move_optimise(fas_optimiser *o, size_t n, size_t *items);
+int best_single_move(fas_optimiser *o, size_t n, size_t *items, size_t index);
+int force_connectivity(fas_optimiser *o, size_t n, size_t *items);
+int local_sort(fas_optimiser *o, size_t n, size_t *items);
+// local_sort without the beater lists, which must give the same result
+int local_insertion_sort(fas_optimiser *o, size_t n, size_t *items);
+int kwik_sort(fas_optimiser *o, size_t n, size_t *data, size_t depth);
+int partial_kwik_sort(fas_optimiser *o, size_t n, size_t *data, size_t k, size_t depth);
+void population_optimise(fas_optimiser *o, size_t n, size_t *items, size_t initial_size, size_t generations);
+void comprehensive_smoothing(fas_optimiser *o, size_t n, size_t *results);
+
+// clean[p] is set when no item after position p strictly beats one at or
+// before it, so the ordering can be split after p without losing anything.
+// The result is malloced and n long.
+unsigned char *condorcet_cuts(fas_optimiser *o, size_t n, size_t *items);
+
+// Same as comparing W_ij with W_ji, but a single lookup in the margin matrix
+static inline int margin_compare(fas_optimiser *o, size_t i, size_t j){
+  double margin = margin_matrix_get(o->margins, i, j);
+
+  if(margin < ACCURACY && margin > -ACCURACY) return 0;
+
+  return margin >= 0 ? -1 : +1;
+}
+
+#endif
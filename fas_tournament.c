@@ -1,18 +1,30 @@
+#define _POSIX_C_SOURCE 200809L
 #include "fas_tournament.h"
 #include "permutations.h"
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
-#include "optimisation_table.h"
-#include "population.h"
+#include <stdint.h>
+#include "fas_optimiser.h"
+#include "parallel.h"
+#include "checkpoint.h"
+#include "exact_kernels.h"
+#include "planner.h"
 
-#define ACCURACY 0.001
 #define SMOOTHING 0.05
 #define MAX_MISSES 5
 #define MIN_IMPROVEMENT 0.00001
-
-#define FASDEBUG(...) if(_enable_fas_tournament_debug) fprintf(stderr, __VA_ARGS__);
+#define KWIK_SORT_MAX_DEPTH 10
+// Windows up to this size fit in the initial scratch arena
+#define SCRATCH_WINDOW 15
+// local_sort uses beater lists on orderings at least this long, if at most
+// this fraction of pairs aren't ties
+#define LOCAL_SORT_SPARSE_MIN 64
+#define LOCAL_SORT_MAX_STRICT 0.125
+// How far either side of a move single_move_optimise looks again
+#define SINGLE_MOVE_RADIUS 8
 
 int _enable_fas_tournament_debug = 0;
 
@@ -20,72 +32,275 @@ void enable_fas_tournament_debug(int x){
   _enable_fas_tournament_debug = x;
 }
 
-tournament *new_tournament(size_t n){
-  size_t size = sizeof(tournament) + sizeof(double) * n * n;
+#define FIXED16_MAX 65535
+
+static size_t precision_entry_size(tournament_precision precision){
+  switch(precision){
+    case TOURNAMENT_FLOAT: return sizeof(float);
+    case TOURNAMENT_FIXED16: return sizeof(uint16_t);
+    default: return sizeof(double);
+  }
+}
+
+// Raw access to the entry at index, decoding fixed point values with an
+// explicit scale so that rescaling passes can read and write with
+// different ones.
+static inline double tournament_load(tournament *t, size_t index, double scale){
+  switch(t->precision){
+    case TOURNAMENT_FLOAT: return t->entries.f[index];
+    case TOURNAMENT_FIXED16: return t->entries.q[index] * scale;
+    default: return t->entries.d[index];
+  }
+}
+
+static inline void tournament_store(tournament *t, size_t index, double x, double scale){
+  switch(t->precision){
+    case TOURNAMENT_FLOAT:
+      t->entries.f[index] = (float)x;
+      break;
+    case TOURNAMENT_FIXED16: {
+      double q = x / scale + 0.5;
+      t->entries.q[index] = q <= 0 ? 0 : (q >= FIXED16_MAX ? FIXED16_MAX : (uint16_t)q);
+      break;
+    }
+    default:
+      t->entries.d[index] = x;
+  }
+}
+
+tournament *new_tournament_with_precision(size_t n, tournament_precision precision){
+  size_t size = sizeof(tournament) + precision_entry_size(precision) * n * n;
   tournament *t = malloc(size);
   memset(t, '\0', size);
   t->size = n;
+  t->precision = precision;
+  t->scale = 1.0 / FIXED16_MAX;
+  t->entries.d = (double*)(t + 1);
   return t;
 }
 
-tournament *normalize_tournament(tournament *t){
-    double max_total = 0.0;
-    for(size_t i = 0; i < t->size; i++){
-        for(size_t j = i + 1; j < t->size; j++){
-            double total = tournament_get(t, i, j) + tournament_get(t, j, i);
-            if(total > max_total) {
-                max_total = total;
-            }
-        }
+tournament *new_tournament(size_t n){
+  return new_tournament_with_precision(n, TOURNAMENT_DOUBLE);
+}
+
+tournament *convert_tournament(tournament *t, tournament_precision precision){
+  size_t n = t->size;
+  tournament *ct = new_tournament_with_precision(n, precision);
+
+  if(precision == TOURNAMENT_FIXED16){
+    double max_entry = 0.0;
+    for(size_t i = 0; i < n * n; i++){
+      double x = tournament_load(t, i, t->scale);
+      if(x > max_entry) max_entry = x;
     }
-    tournament *nt = new_tournament(t->size);
-    if(max_total <= 0.0){
-        for(size_t i = 0; i < t->size; i++){
-            for(size_t j = 0; j < t->size; j++){
-                tournament_set(nt, i, j, 0.5);
-            }
-        }
-    } else {
-        for(size_t i = 0; i < t->size; i++){
-            tournament_set(nt, i, i, 0.5);
-            for(size_t j = i + 1; j < t->size; j++){
-                double tij = tournament_get(t, i, j);
-                double tji = tournament_get(t, j, i);
-                double bonus = (max_total - (tij + tji)) / 2;
-                tij += bonus;
-                tji += bonus;
-                tij /= max_total;
-                tji /= max_total;
-                tournament_set(nt, i, j, tij);
-                tournament_set(nt, j, i, tji);
-            }
-        }
+    if(max_entry > 0.0) ct->scale = max_entry / FIXED16_MAX;
+  }
+
+  for(size_t i = 0; i < n * n; i++){
+    tournament_store(ct, i, tournament_load(t, i, t->scale), ct->scale);
+  }
+  return ct;
+}
+
+tournament *resize_tournament(tournament *t, size_t n){
+  tournament *rt = new_tournament_with_precision(n, t->precision);
+  rt->scale = t->scale;
+
+  size_t common = n < t->size ? n : t->size;
+  for(size_t i = 0; i < common; i++){
+    for(size_t j = 0; j < common; j++){
+      tournament_store(rt, n * i + j, tournament_load(t, t->size * i + j, t->scale), rt->scale);
     }
+  }
+  return rt;
+}
 
-    return nt;
+int parse_tournament_precision(const char *name, tournament_precision *precision){
+  if(!strcmp(name, "double")) *precision = TOURNAMENT_DOUBLE;
+  else if(!strcmp(name, "float")) *precision = TOURNAMENT_FLOAT;
+  else if(!strcmp(name, "fixed16")) *precision = TOURNAMENT_FIXED16;
+  else return 0;
+  return 1;
 }
 
-void del_tournament(tournament *t){
-  free(t);
+const char *tournament_precision_name(tournament_precision precision){
+  switch(precision){
+    case TOURNAMENT_FLOAT: return "float";
+    case TOURNAMENT_FIXED16: return "fixed16";
+    default: return "double";
+  }
 }
 
+#define NORMALIZE_BLOCK 64
+
+// Work on normalisation is split into bands of NORMALIZE_BLOCK rows. Band b
+// owns every pair (i, j) with i in the band and j > i, and visits them one
+// NORMALIZE_BLOCK wide tile at a time so the transposed reads of t[j][i]
+// stay in cache.
 typedef struct {
-  size_t *buffer;
-  optimisation_table *opt_table;
   tournament *tournament;
-} fas_optimiser;
+  double max_total;
+  double *band_maxima;
+  double read_scale;
+  double write_scale;
+} normalize_job;
+
+static void max_total_band(void *context, size_t band){
+  normalize_job *job = context;
+  tournament *t = job->tournament;
+  size_t n = t->size;
+  double scale = t->scale;
+  double max_total = 0.0;
+
+  size_t i_start = band * NORMALIZE_BLOCK;
+  size_t i_end = i_start + NORMALIZE_BLOCK < n ? i_start + NORMALIZE_BLOCK : n;
+
+  for(size_t j_start = i_start; j_start < n; j_start += NORMALIZE_BLOCK){
+    size_t j_end = j_start + NORMALIZE_BLOCK < n ? j_start + NORMALIZE_BLOCK : n;
+    for(size_t i = i_start; i < i_end; i++){
+      for(size_t j = (j_start > i ? j_start : i + 1); j < j_end; j++){
+        double total = tournament_load(t, n * i + j, scale) + tournament_load(t, n * j + i, scale);
+        max_total = total > max_total ? total : max_total;
+      }
+    }
+  }
+
+  job->band_maxima[band] = max_total;
+}
+
+static void normalize_band(void *context, size_t band){
+  normalize_job *job = context;
+  tournament *t = job->tournament;
+  size_t n = t->size;
+  double rs = job->read_scale;
+  double ws = job->write_scale;
+  double scale = 0.5 / job->max_total;
+
+  size_t i_start = band * NORMALIZE_BLOCK;
+  size_t i_end = i_start + NORMALIZE_BLOCK < n ? i_start + NORMALIZE_BLOCK : n;
+
+  for(size_t j_start = i_start; j_start < n; j_start += NORMALIZE_BLOCK){
+    size_t j_end = j_start + NORMALIZE_BLOCK < n ? j_start + NORMALIZE_BLOCK : n;
+    for(size_t i = i_start; i < i_end; i++){
+      if(j_start <= i) tournament_store(t, n * i + i, 0.5, ws);
+      for(size_t j = (j_start > i ? j_start : i + 1); j < j_end; j++){
+        double margin = (tournament_load(t, n * i + j, rs) - tournament_load(t, n * j + i, rs)) * scale;
+        tournament_store(t, n * i + j, 0.5 + margin, ws);
+        tournament_store(t, n * j + i, 0.5 - margin, ws);
+      }
+    }
+  }
+}
+
+static size_t normalize_band_count(tournament *t){
+  return (t->size + NORMALIZE_BLOCK - 1) / NORMALIZE_BLOCK;
+}
+
+double tournament_max_total(tournament *t){
+  size_t bands = normalize_band_count(t);
+  normalize_job job;
+  job.tournament = t;
+  job.band_maxima = malloc(sizeof(double) * bands);
+
+  parallel_for(bands, max_total_band, &job);
+
+  double max_total = 0.0;
+  for(size_t b = 0; b < bands; b++){
+    if(job.band_maxima[b] > max_total) max_total = job.band_maxima[b];
+  }
+  free(job.band_maxima);
+  return max_total;
+}
+
+// Normalising pads each pair with equal weight until its total is
+// max_total and then divides through, which simplifies to
+// 0.5 +/- (t_ij - t_ji) / (2 max_total).
+double normalized_tournament_get(tournament *t, double max_total, size_t i, size_t j){
+  if(i == j || max_total <= 0.0) return 0.5;
+  return 0.5 + (tournament_get(t, i, j) - tournament_get(t, j, i)) * (0.5 / max_total);
+}
+
+void normalize_tournament_in_place(tournament *t){
+  double max_total = tournament_max_total(t);
+  size_t n = t->size;
+
+  // Normalised entries all lie in [0, 1]
+  double write_scale = 1.0 / FIXED16_MAX;
+
+  if(max_total <= 0.0){
+    for(size_t i = 0; i < n * n; i++) tournament_store(t, i, 0.5, write_scale);
+  } else {
+    normalize_job job;
+    job.tournament = t;
+    job.max_total = max_total;
+    job.band_maxima = NULL;
+    job.read_scale = t->scale;
+    job.write_scale = write_scale;
+    parallel_for(normalize_band_count(t), normalize_band, &job);
+  }
+
+  t->scale = write_scale;
+}
+
+tournament *normalize_tournament(tournament *t){
+  tournament *nt = convert_tournament(t, t->precision);
+  normalize_tournament_in_place(nt);
+  return nt;
+}
+
+void del_tournament(tournament *t){
+  free(t);
+}
+
+// kwik_sort holds two arrays of up to n items at each level of recursion,
+// improve_population one, and table_optimise two of each size up to the
+// window it was called with
+static size_t scratch_capacity(size_t n){
+  return sizeof(size_t) * (2 * n * KWIK_SORT_MAX_DEPTH + n + SCRATCH_WINDOW * (SCRATCH_WINDOW + 1));
+}
 
 fas_optimiser *new_optimiser(tournament *t){
   fas_optimiser *it = malloc(sizeof(fas_optimiser));
   it->buffer = malloc(sizeof(size_t) * t->size);
   it->opt_table = optimisation_table_new();
   it->tournament = t;
+  it->margins = margin_matrix_new(t);
+  it->owns_margins = 1;
+  it->shared_table = NULL;
+  it->beaters = NULL;
+  it->beaters_checked = 0;
+  it->deadline = 0;
+  it->scratch = scratch_arena_new(scratch_capacity(t->size));
+  // Seeded from rand() so that srand still controls a whole run
+  random_seed(&it->rng, ((uint64_t)rand() << 31) ^ (uint64_t)rand());
+  return it;
+}
+
+// A second optimiser over the same tournament for use on another thread.
+// The margin matrix is read only and is shared, everything else is private.
+fas_optimiser *new_optimiser_sharing(fas_optimiser *parent, uint64_t seed){
+  fas_optimiser *it = malloc(sizeof(fas_optimiser));
+  it->buffer = malloc(sizeof(size_t) * parent->tournament->size);
+  it->opt_table = optimisation_table_new();
+  it->tournament = parent->tournament;
+  it->margins = parent->margins;
+  it->owns_margins = 0;
+  it->shared_table = parent->shared_table;
+  it->beaters = NULL;
+  it->beaters_checked = 0;
+  it->deadline = 0;
+  it->scratch = scratch_arena_new(scratch_capacity(parent->tournament->size));
+  random_seed(&it->rng, seed);
   return it;
 }
 
 void del_optimiser(fas_optimiser *o){
+  FASDEBUG("Peak scratch arena usage: %lu bytes\n", (unsigned long)o->scratch->peak);
+  scratch_arena_del(o->scratch);
   free(o->buffer);
   optimisation_table_del(o->opt_table);
+  if(o->owns_margins) margin_matrix_del(o->margins);
+  beater_lists_del(o->beaters);
   free(o);
 }
 
@@ -94,6 +309,17 @@ void reset_optimiser(fas_optimiser *opt){
   opt->opt_table = optimisation_table_new();
 }
 
+static double monotonic_seconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int optimiser_stopping(fas_optimiser *o){
+  if(checkpoint_terminating()) return 1;
+  return o->deadline > 0 && monotonic_seconds() >= o->deadline;
+}
+
 size_t tournament_size(tournament *t){
   return t->size;
 }
@@ -102,29 +328,31 @@ inline double tournament_get(tournament *t, size_t i, size_t j){
   size_t n = t->size;
   assert(i < n); 
   assert(j < n);
-  return t->entries[n * i + j];
+  return tournament_load(t, n * i + j, t->scale);
 }
 
-inline void tournament_set(tournament *t, size_t i, size_t j, double x){
+// Rounding to the nearest fixed point step is fine, but anything that would
+// round to below 0 or above FIXED16_MAX steps can't be stored.
+int tournament_try_set(tournament *t, size_t i, size_t j, double x){
   size_t n = t->size;
   assert(i < n); 
   assert(j < n);
-  t->entries[n * i + j] = x;
+  if(t->precision == TOURNAMENT_FIXED16){
+    double q = x / t->scale + 0.5;
+    if(!(q >= 0 && q < FIXED16_MAX + 1)) return 0;
+  }
+  tournament_store(t, n * i + j, x, t->scale);
+  return 1;
 }
 
-double score_fas_tournament(tournament *t, size_t count, size_t *data){
-	double score = 0.0;
-
-	for(size_t i = 0; i < count; i++){
-		for(size_t j = i + 1; j < count; j++){
-			score +=  t->entries[data[i] * t->size + data[j]];
-		}
-	}
-
-	return score;
+void tournament_set(tournament *t, size_t i, size_t j, double x){
+  if(!tournament_try_set(t, i, j, x)){
+    fprintf(stderr, "%g at %lu, %lu is out of range for a fixed16 tournament with largest entry %g\n",
+            x, (unsigned long)i, (unsigned long)j, FIXED16_MAX * t->scale);
+    exit(1);
+  }
 }
 
-
 static size_t count_tokens(char *c){
   if(*c == '\0') return 0;
 
@@ -183,11 +411,76 @@ static void fail(char *msg){
   exit(1);
 }
 
+void write_tournament_binary_header(FILE *f, size_t n){
+  uint64_t size = n;
+  fwrite(TOURNAMENT_BINARY_MAGIC, 1, strlen(TOURNAMENT_BINARY_MAGIC), f);
+  fwrite(&size, sizeof(uint64_t), 1, f);
+}
+
+void write_tournament_binary_entry(FILE *f, size_t i, size_t j, double x){
+  uint64_t indices[2] = { i, j };
+  fwrite(indices, sizeof(uint64_t), 2, f);
+  fwrite(&x, sizeof(double), 1, f);
+}
+
+int tournaments_equal(tournament *s, tournament *t){
+  if(s->size != t->size) return 0;
+  size_t n = t->size;
+  for(size_t i = 0; i < n; i++){
+    for(size_t j = 0; j < n; j++){
+      if(tournament_get(s, i, j) != tournament_get(t, i, j)) return 0;
+    }
+  }
+  return 1;
+}
+
+void write_tournament_binary(tournament *t, FILE *f){
+  size_t n = t->size;
+  write_tournament_binary_header(f, n);
+  for(size_t i = 0; i < n; i++){
+    for(size_t j = 0; j < n; j++){
+      double x = tournament_get(t, i, j);
+      if(x != 0.0) write_tournament_binary_entry(f, i, j, x);
+    }
+  }
+}
+
+static tournament *read_tournament_binary(FILE *f){
+  char magic[sizeof(TOURNAMENT_BINARY_MAGIC)];
+  size_t magic_length = strlen(TOURNAMENT_BINARY_MAGIC);
+
+  if(fread(magic, 1, magic_length, f) != magic_length ||
+     memcmp(magic, TOURNAMENT_BINARY_MAGIC, magic_length)){
+    fail("Bad magic for binary tournament");
+  }
+
+  uint64_t n;
+  if(fread(&n, sizeof(uint64_t), 1, f) != 1) fail("Truncated binary tournament header");
+  if(n <= 0) fail("Empty tournament");
+
+  tournament *t = new_tournament(n);
+
+  uint64_t indices[2];
+  double x;
+  while(fread(indices, sizeof(uint64_t), 2, f) == 2){
+    if(fread(&x, sizeof(double), 1, f) != 1) fail("Truncated binary tournament entry");
+    if(indices[0] >= n || indices[1] >= n) fail("index out of bounds");
+    t->entries.d[n * indices[0] + indices[1]] += x;
+  }
+
+  fclose(f);
+  return t;
+}
+
 tournament *read_tournament(FILE *f){
   size_t length = 1024;
   char *line = NULL;
   tournament *t;
 
+  int first = getc(f);
+  ungetc(first, f);
+  if(first == TOURNAMENT_BINARY_MAGIC[0]) return read_tournament_binary(f);
+
   if(!read_line(&length, &line, f)){
     fail("No data for read_tournament");
   }
@@ -221,7 +514,7 @@ tournament *read_tournament(FILE *f){
 
     if(i >= n || j >= n) fail("index out of bounds");
 
-    t->entries[n * i + j] += f;
+    t->entries.d[n * i + j] += f;
   }
   free(line);
   fclose(f);
@@ -246,82 +539,202 @@ static inline void swap(size_t *x, size_t *y){
 	*y = z;
 }
 
-int table_optimise(fas_optimiser *o, size_t n, size_t *items){
-  tournament *t = o->tournament;
+// Tries each item in turn at the front, with the rest ordered optimally,
+// and leaves the best of those orderings in best. Returns its score, which
+// is existing_score unless something better was found.
+static double best_first_item(fas_optimiser *o, size_t n, size_t *items, size_t *best, double existing_score){
+  scratch_mark mark = scratch_save(o->scratch);
+  size_t *pristine_copy = scratch_alloc(o->scratch, n * sizeof(size_t));
+  memcpy(pristine_copy, items, n * sizeof(size_t));
+  memcpy(best, items, n * sizeof(size_t));
+
+  double best_score_so_far = existing_score;
+
+  for(size_t i = 0; i < n; i++){
+    memcpy(items, pristine_copy, n * sizeof(size_t));
+    swap(items, items + i);
+    table_optimise(o, n-1, items+1);
+    double new_score = margin_score(o->margins, n, items);
+    if(new_score > best_score_so_far){
+      memcpy(best, items, n * sizeof(size_t));
+      best_score_so_far = new_score;
+    }
+  }
+
+  scratch_release(o->scratch, mark);
+  return best_score_so_far;
+}
+
+static double shared_table_optimise(fas_optimiser *o, size_t n, size_t *items){
+  double existing_score = margin_score(o->margins, n, items);
+  scratch_mark mark = scratch_save(o->scratch);
+  size_t *best = scratch_alloc(o->scratch, n * sizeof(size_t));
+  double value;
+  double gain = 0;
+
+  if(shared_optimisation_table_get(o->shared_table, n, items, &value, best)){
+    if(existing_score < value){
+      gain = value - existing_score;
+      memcpy(items, best, n * sizeof(size_t));
+    }
+  } else {
+    value = best_first_item(o, n, items, best, existing_score);
+    if(value > existing_score) gain = value - existing_score;
+    memcpy(items, best, n * sizeof(size_t));
+    shared_optimisation_table_put(o->shared_table, n, best, value);
+  }
+
+  scratch_release(o->scratch, mark);
+  return gain;
+}
+
+// The exact kernels don't need memoised subsets, but windows are often
+// revisited unchanged, so the result for the whole window is still memoised
+static double exact_table_optimise(fas_optimiser *o, size_t n, size_t *items, exact_kernel kernel){
+  double existing_score = margin_score(o->margins, n, items);
+  scratch_mark mark = scratch_save(o->scratch);
+  size_t *best = scratch_alloc(o->scratch, n * sizeof(size_t));
+  double value;
+  int known;
+
+  if(o->shared_table){
+    known = shared_optimisation_table_get(o->shared_table, n, items, &value, best);
+  } else {
+    ot_entry *ote = optimisation_table_lookup(o->opt_table, n, items);
+    known = ote->value != OT_UNKNOWN;
+    if(known){
+      value = ote->value;
+      memcpy(best, ote->data, n * sizeof(size_t));
+    }
+  }
+
+  if(!known){
+    kernel(o->margins, items, best);
+    value = margin_score(o->margins, n, best);
+    if(o->shared_table){
+      shared_optimisation_table_put(o->shared_table, n, best, value);
+    } else {
+      ot_entry *ote = optimisation_table_lookup(o->opt_table, n, items);
+      ote->value = value;
+      memcpy(ote->data, best, n * sizeof(size_t));
+    }
+  }
+
+  double gain = 0;
+  if(existing_score < value){
+    gain = value - existing_score;
+    memcpy(items, best, n * sizeof(size_t));
+  }
+  scratch_release(o->scratch, mark);
+  return gain;
+}
+
+// table_optimise, returning how much it raised the margin sum of items
+// (twice the rise in their score) rather than just whether it did
+static double table_optimise_gain(fas_optimiser *o, size_t n, size_t *items){
 	if(n <= 1) return 0;
 	if(n == 2){
-		int c = tournament_compare(t, items[0], items[1]);
-		if(c > 0) swap(items, items+1);
-		return c > 0;
+		if(margin_compare(o, items[0], items[1]) <= 0) return 0;
+		double gain = margin_matrix_get(o->margins, items[1], items[0]);
+		swap(items, items+1);
+		return gain;
 	}
 
+  exact_kernel kernel = exact_kernel_for(n);
+  if(kernel) return exact_table_optimise(o, n, items, kernel);
+
+  if(o->shared_table) return shared_table_optimise(o, n, items);
+
   ot_entry *ote = optimisation_table_lookup(o->opt_table, n, items);
 
-  double existing_score = score_fas_tournament(t, n, items);
+  // Every candidate ordering has the same items, so margin sums are enough
+  double existing_score = margin_score(o->margins, n, items);
 
-  if(ote->value >= 0){
+  if(ote->value != OT_UNKNOWN){
     // We already have a best calculation for this entry
     if(existing_score < ote->value){
       // We know a better way to order these
       memcpy(items, ote->data, n * sizeof(size_t));
-      return 1;
+      return ote->value - existing_score;
     } else {
       return 0;
     }
   } else {
-    size_t *best_value_seen = malloc(n * sizeof(size_t));
-    size_t *pristine_copy = malloc(n * sizeof(size_t));
-    memcpy(pristine_copy, items, n * sizeof(size_t));
-    memcpy(best_value_seen, items, n * sizeof(size_t));
-
-    int changed = 0;
-
-    double best_score_so_far = existing_score;
-
-    for(size_t i = 0; i < n; i++){
-      memcpy(items, pristine_copy, n * sizeof(size_t));
-      swap(items, items + i);
-      table_optimise(o, n-1, items+1);
-      double new_score = score_fas_tournament(t, n, items);
-      if(new_score > best_score_so_far){
-        memcpy(best_value_seen, items, n * sizeof(size_t));
-        changed = 1;
-        best_score_so_far = new_score;
-      }
-    }
+    scratch_mark mark = scratch_save(o->scratch);
+    size_t *best_value_seen = scratch_alloc(o->scratch, n * sizeof(size_t));
+    double best_score_so_far = best_first_item(o, n, items, best_value_seen, existing_score);
+    double gain = best_score_so_far > existing_score ? best_score_so_far - existing_score : 0;
 
     ote = optimisation_table_lookup(o->opt_table, n, items);
     memcpy(items, best_value_seen, n * sizeof(size_t));
     ote->value = best_score_so_far;
     memcpy(ote->data, items, n * sizeof(size_t));
 
-    free(best_value_seen);
-    free(pristine_copy);
-    return changed;
+    scratch_release(o->scratch, mark);
+    return gain;
   }
 }
 
+int table_optimise(fas_optimiser *o, size_t n, size_t *items){
+  return table_optimise_gain(o, n, items) > 0;
+}
+
+// A window only needs optimising again once something in it has changed
+// since it was last optimised, so every position records the step at which
+// it last changed and every window the step at which it was last run.
+// Later sweeps only pay for windows near the changes of the sweep before.
+// The ordering is scored once, and after that each sweep's improvement is
+// the sum of what its windows gained, so a sweep costs nothing for the
+// windows it skips.
 int window_optimise(fas_optimiser *o, size_t n, size_t *items, size_t window){
   if(n <= window){
     return table_optimise(o, n, items);
   }
+  scratch_mark mark = scratch_save(o->scratch);
+  size_t *changed_at = scratch_alloc(o->scratch, n * sizeof(size_t));
+  size_t *optimised_at = scratch_alloc(o->scratch, (n - window) * sizeof(size_t));
+  size_t *before = scratch_alloc(o->scratch, window * sizeof(size_t));
+  memset(changed_at, 0, n * sizeof(size_t));
+  memset(optimised_at, 0, (n - window) * sizeof(size_t));
+  size_t step = 0;
+
   double last_score = score_fas_tournament(o->tournament, n, items);
   int changed_at_all = 0;
   int changed = 1;
   while(changed){
     changed = 0;
+    double gain = 0;
     for(size_t i = 0; i < n - window; i++){
-      changed |= table_optimise(o, window, items + i); 
+      if(optimiser_stopping(o)) break;
+      if(optimised_at[i]){
+        size_t latest = 0;
+        for(size_t k = i; k < i + window; k++){
+          if(changed_at[k] > latest) latest = changed_at[k];
+        }
+        if(latest <= optimised_at[i]) continue;
+      }
+
+      step++;
+      memcpy(before, items + i, window * sizeof(size_t));
+      double window_gain = table_optimise_gain(o, window, items + i);
+      if(window_gain > 0){
+        changed = 1;
+        gain += window_gain;
+        for(size_t k = 0; k < window; k++){
+          if(items[i + k] != before[k]) changed_at[i + k] = step;
+        }
+      }
+      optimised_at[i] = step;
     }
-    double new_score = score_fas_tournament(o->tournament, n, items);
+    // Margin sums count every pair's difference, which is twice its score
+    double improvement = gain / 2 / last_score;
 
-    double improvement = (new_score - last_score) / last_score;
-    
-    changed_at_all |= changed; 
+    changed_at_all |= changed;
     if(improvement < MIN_IMPROVEMENT) break;
-    last_score = new_score;
+    last_score += gain / 2;
   }
 
+  scratch_release(o->scratch, mark);
   return changed_at_all;
 }
 
@@ -340,65 +753,153 @@ int compare_index_with_score(const void *xx, const void *yy){
   return 0;
 }
 
-// Insertion sort for now. Everything else is O(n^2) anyway
+// Moves *x offset places along, shifting everything it passes by one
 static void move_pointer_right(size_t *x, size_t offset){
-  while(offset){
-    size_t *next = x + 1;
-    swap(x, next);
-    x = next;
-    offset--;
-  }
+  size_t moving = *x;
+  memmove(x, x + 1, offset * sizeof(size_t));
+  x[offset] = moving;
 }
 
 static void move_pointer_left(size_t *x, size_t offset){
-  while(offset){
-    size_t *next = x - 1;
-    swap(x, next);
-    x = next;
-    offset--;
-  }
+  size_t moving = *x;
+  memmove(x - offset + 1, x - offset, offset * sizeof(size_t));
+  *(x - offset) = moving;
 }
 
-int single_move_optimise(fas_optimiser *o, size_t n, size_t *items){
-  tournament *t = o->tournament;
-  int changed = 1;
-  int changed_at_all = 0;
-  while(changed){
-    changed = 0;
-    for(size_t index_of_interest = 0; index_of_interest < n; index_of_interest++){
-      double score_delta = 0;
-
-      if(index_of_interest > 0){
-        size_t j = index_of_interest;
-        do {
-          j--;
-          score_delta += tournament_get(t, items[index_of_interest], items[j]);
-          score_delta -= tournament_get(t, items[j], items[index_of_interest]);
-
-          if(score_delta > 0){
-            move_pointer_left(items+index_of_interest, index_of_interest - j);
-            changed = 1; 
-            break;
-          }
-        } while(j > 0);
-      }
+static void move_flag_right(unsigned char *x, size_t offset){
+  unsigned char moving = *x;
+  memmove(x, x + 1, offset);
+  x[offset] = moving;
+}
 
-      for(size_t j = index_of_interest + 1; j < n; j++){
-        score_delta += tournament_get(t, items[j], items[index_of_interest]);
-        score_delta -= tournament_get(t, items[index_of_interest], items[j]);
+static void move_flag_left(unsigned char *x, size_t offset){
+  unsigned char moving = *x;
+  memmove(x - offset + 1, x - offset, offset);
+  *(x - offset) = moving;
+}
+
+// Flags for the next pass every position within SINGLE_MOVE_RADIUS of a
+// move's span, the span itself being every position whose item shifted
+static void mark_moved(size_t n, unsigned char *dirty, size_t from, size_t to){
+  size_t lo = from < to ? from : to;
+  size_t hi = from < to ? to : from;
+  lo = lo > SINGLE_MOVE_RADIUS ? lo - SINGLE_MOVE_RADIUS : 0;
+  hi = hi + SINGLE_MOVE_RADIUS < n ? hi + SINGLE_MOVE_RADIUS : n - 1;
+  memset(dirty + lo, 1, hi - lo + 1);
+}
+
+// One pass of single_move_optimise over the positions flagged in check, or
+// over everything if check is NULL. Flags move with their items.
+static int single_move_pass(fas_optimiser *o, size_t n, size_t *items,
+                            unsigned char *check, unsigned char *dirty, int *changed_at_all){
+  margin_matrix *m = o->margins;
+  int changed = 0;
+
+  for(size_t index_of_interest = 0; index_of_interest < n; index_of_interest++){
+    if(check && !check[index_of_interest]) continue;
+    if(optimiser_stopping(o)) break;
+    double score_delta = 0;
+
+    if(index_of_interest > 0){
+      size_t j = index_of_interest;
+      do {
+        j--;
+        score_delta += margin_matrix_get(m, items[index_of_interest], items[j]);
 
         if(score_delta > 0){
-          move_pointer_right(items+index_of_interest, j - index_of_interest);
+          size_t offset = index_of_interest - j;
+          move_pointer_left(items+index_of_interest, offset);
+          if(check) move_flag_left(check+index_of_interest, offset);
+          move_flag_left(dirty+index_of_interest, offset);
+          mark_moved(n, dirty, j, index_of_interest);
           changed = 1; 
-          changed_at_all = 1;
           break;
         }
+      } while(j > 0);
+    }
+
+    for(size_t j = index_of_interest + 1; j < n; j++){
+      score_delta += margin_matrix_get(m, items[j], items[index_of_interest]);
+
+      if(score_delta > 0){
+        size_t offset = j - index_of_interest;
+        move_pointer_right(items+index_of_interest, offset);
+        if(check) move_flag_right(check+index_of_interest, offset);
+        move_flag_right(dirty+index_of_interest, offset);
+        mark_moved(n, dirty, index_of_interest, j);
+        changed = 1; 
+        *changed_at_all = 1;
+        break;
       }
     }
   }
+
+  return changed;
+}
+
+// Passes after the first only look at positions near the previous pass's
+// moves, as everywhere else is as it was when it last found nothing. That
+// isn't quite a guarantee, because a move shifts the partial sums of every
+// item whose scan crosses it, so when the dirty positions run dry a full
+// pass checks the whole ordering again.
+int single_move_optimise(fas_optimiser *o, size_t n, size_t *items){
+  if(!n) return 0;
+  scratch_mark mark = scratch_save(o->scratch);
+  unsigned char *check = scratch_alloc(o->scratch, n);
+  unsigned char *dirty = scratch_alloc(o->scratch, n);
+  int changed_at_all = 0;
+  int full = 1;
+
+  while(!optimiser_stopping(o)){
+    memset(dirty, 0, n);
+    int changed = single_move_pass(o, n, items, full ? NULL : check, dirty, &changed_at_all);
+    if(!changed){
+      if(full) break;
+      full = 1;
+      continue;
+    }
+    full = 0;
+    unsigned char *swap_flags = check;
+    check = dirty;
+    dirty = swap_flags;
+  }
+
+  scratch_release(o->scratch, mark);
   return changed_at_all;
 }
 
+// Moves items[index] to whichever position gives the biggest improvement,
+// rather than the first improving one that single_move_optimise settles for.
+int best_single_move(fas_optimiser *o, size_t n, size_t *items, size_t index){
+  margin_matrix *m = o->margins;
+  size_t x = items[index];
+  size_t best_index = index;
+  double best_delta = 0;
+  double score_delta = 0;
+
+  for(size_t j = index; j > 0; j--){
+    score_delta += margin_matrix_get(m, x, items[j - 1]);
+    if(score_delta > best_delta){
+      best_delta = score_delta;
+      best_index = j - 1;
+    }
+  }
+
+  score_delta = 0;
+  for(size_t j = index + 1; j < n; j++){
+    score_delta += margin_matrix_get(m, items[j], x);
+    if(score_delta > best_delta){
+      best_delta = score_delta;
+      best_index = j;
+    }
+  }
+
+  if(best_index < index) move_pointer_left(items + index, index - best_index);
+  else if(best_index > index) move_pointer_right(items + index, best_index - index);
+
+  return best_index != index;
+}
+
 size_t *integer_range(size_t n){
   size_t *results = malloc(sizeof(size_t) * n);
 	for(size_t i = 0; i < n; i++){
@@ -407,14 +908,15 @@ size_t *integer_range(size_t n){
   return results;
 }
 
+// Pulls the first item after each position that isn't tied with it up to
+// sit straight after it, as one block move
 int force_connectivity(fas_optimiser *o, size_t n, size_t *items){
   if(!n) return 0;
   int changed = 0;
-  tournament *t = o->tournament;
   for(size_t i = 0; i < n - 1; i++){
     size_t j = i + 1;
-    while(j < n && !tournament_compare(t, items[i], items[j])) j++;
-    if(j < n){
+    while(j < n && !margin_compare(o, items[i], items[j])) j++;
+    if(j < n && j > i + 1){
       changed = 1;
       move_pointer_left(items + j, (j - i - 1));
     }
@@ -423,16 +925,27 @@ int force_connectivity(fas_optimiser *o, size_t n, size_t *items){
 }
 
 
+// Moves each item left past everything that doesn't strictly beat it, so
+// it ends up straight after the last item before it that does. On sparse
+// tournaments items travel a long way, so there the beater lists find the
+// stopping point directly instead of comparing against everything passed.
 int local_sort(fas_optimiser *o, size_t n, size_t *items){
-  tournament *t = o->tournament;
+  if(n >= LOCAL_SORT_SPARSE_MIN && !o->beaters_checked){
+    o->beaters = beater_lists_new(o->margins, ACCURACY, LOCAL_SORT_MAX_STRICT);
+    o->beaters_checked = 1;
+  }
+  if(n >= LOCAL_SORT_SPARSE_MIN && o->beaters) return beater_lists_sort(o->beaters, n, items);
+  return local_insertion_sort(o, n, items);
+}
+
+int local_insertion_sort(fas_optimiser *o, size_t n, size_t *items){
   int changed = 0;
   for(size_t i = 1; i < n; i++){
     size_t j = i;
-
-    while(j > 0 && tournament_compare(t, items[j], items[j - 1]) <= 0){
+    while(j > 0 && margin_compare(o, items[i], items[j - 1]) <= 0) j--;
+    if(j < i){
       changed = 1;
-      swap(items + j, items + j - 1);
-      j--;
+      move_pointer_left(items + i, i - j);
     }
   }
   
@@ -450,25 +963,43 @@ int stride_optimise(fas_optimiser *o, size_t n, size_t *data, size_t stride){
   return changed;
 }
 
+// stride_optimise, skipping blocks which are the same as in last, the
+// ordering as the previous pass at this stride left it. Those are already
+// optimal.
+static int stride_optimise_since(fas_optimiser *o, size_t n, size_t *data, size_t stride, size_t *last){
+  int changed = 0;
+  size_t start = 0;
+  do {
+    size_t length = n - start > stride ? stride : n - start;
+    if(memcmp(data + start, last + start, length * sizeof(size_t))){
+      changed |= table_optimise(o, length, data + start);
+    }
+    start += length;
+  } while(start < n);
+  memcpy(last, data, n * sizeof(size_t));
+  return changed;
+}
+
 
 
 int kwik_sort(fas_optimiser *o, size_t n, size_t *data, size_t depth){
   if(n <= 1) return 0;
-  if(depth >= 10) return 0;
+  if(depth >= KWIK_SORT_MAX_DEPTH) return 0;
 
-  size_t *lt = malloc(n * sizeof(size_t));
-  size_t *gt = malloc(n * sizeof(size_t));
+  scratch_mark mark = scratch_save(o->scratch);
+  size_t *lt = scratch_alloc(o->scratch, n * sizeof(size_t));
+  size_t *gt = scratch_alloc(o->scratch, n * sizeof(size_t));
 
   size_t ltn = 0;
   size_t gtn = 0;
 
-  size_t pivot = data[random_number(n)];
+  size_t pivot = data[random_number_r(&o->rng, n)];
  
   for(size_t i = 0; i < n; i++){
-    int c = tournament_compare(o->tournament, data[i], pivot);
+    int c = margin_compare(o, data[i], pivot);
     if(c < 0) lt[ltn++] = data[i];
     else if(c == 0){
-      if(random_number(2)){
+      if(random_number_r(&o->rng, 2)){
         lt[ltn++] = data[i];
       } else {
         gt[gtn++] = data[i];
@@ -484,8 +1015,47 @@ int kwik_sort(fas_optimiser *o, size_t n, size_t *data, size_t depth){
   memcpy(data, lt, sizeof(size_t) * ltn);
   memcpy(data + ltn, gt, sizeof(size_t) * gtn);
 
-  free(lt);
-  free(gt);
+  scratch_release(o->scratch, mark);
+  return 1;
+}
+
+// As kwik_sort, but only orders as much as is needed to get the first k
+// positions right: partitions lying wholly after position k are left as is.
+int partial_kwik_sort(fas_optimiser *o, size_t n, size_t *data, size_t k, size_t depth){
+  if(n <= 1 || k == 0) return 0;
+  if(depth >= KWIK_SORT_MAX_DEPTH) return 0;
+  if(k >= n) return kwik_sort(o, n, data, depth);
+
+  scratch_mark mark = scratch_save(o->scratch);
+  size_t *lt = scratch_alloc(o->scratch, n * sizeof(size_t));
+  size_t *gt = scratch_alloc(o->scratch, n * sizeof(size_t));
+
+  size_t ltn = 0;
+  size_t gtn = 0;
+
+  size_t pivot = data[random_number_r(&o->rng, n)];
+
+  for(size_t i = 0; i < n; i++){
+    int c = margin_compare(o, data[i], pivot);
+    if(c < 0) lt[ltn++] = data[i];
+    else if(c == 0){
+      if(random_number_r(&o->rng, 2)){
+        lt[ltn++] = data[i];
+      } else {
+        gt[gtn++] = data[i];
+      }
+    }
+    else gt[gtn++] = data[i];
+  }
+
+  depth++;
+  partial_kwik_sort(o, ltn, lt, k, depth);
+  if(k > ltn) partial_kwik_sort(o, gtn, gt, k - ltn, depth);
+
+  memcpy(data, lt, sizeof(size_t) * ltn);
+  memcpy(data + ltn, gt, sizeof(size_t) * gtn);
+
+  scratch_release(o->scratch, mark);
   return 1;
 }
 
@@ -495,6 +1065,33 @@ size_t *copy_items(size_t n, size_t *items){
   return copy;
 }
 
+// Positions after which nothing later strictly beats anything earlier.
+// reach[j] is the earliest position that items[j] beats, and a cut after p
+// is clean exactly when every later item's reach is beyond p.
+unsigned char *condorcet_cuts(fas_optimiser *o, size_t n, size_t *items){
+  unsigned char *clean = calloc(n, 1);
+  size_t *reach = malloc(n * sizeof(size_t));
+
+  for(size_t j = 0; j < n; j++){
+    reach[j] = j;
+    for(size_t i = 0; i < j; i++){
+      if(margin_compare(o, items[j], items[i]) < 0){
+        reach[j] = i;
+        break;
+      }
+    }
+  }
+
+  size_t min_reach = n;
+  for(size_t p = n; p-- > 0;){
+    clean[p] = min_reach > p;
+    if(reach[p] < min_reach) min_reach = reach[p];
+  }
+
+  free(reach);
+  return clean;
+}
+
 population *build_population(fas_optimiser *o,
                              size_t n,
                              size_t *items,
@@ -502,9 +1099,16 @@ population *build_population(fas_optimiser *o,
   population *p = population_new(ps, n);
 
   for(size_t i = 0; i < ps; i++){
-    size_t *data = copy_items(n, items);
-    kwik_sort(o, n, data, 0), 
-    p->members[i].data = data;
+    size_t *data = p->members[i].data;
+    memcpy(data, items, n * sizeof(size_t));
+    // The first member is the ordering we were given, so that a caller
+    // who passes in a good starting point doesn't lose it. Out of time,
+    // the rest are copies of it.
+    if(i > 0 && optimiser_stopping(o)){
+      p->members[i].score = p->members[0].score;
+      continue;
+    }
+    if(i > 0) kwik_sort(o, n, data, 0);
     p->members[i].score = score_fas_tournament(o->tournament, n, data);
   }
 
@@ -512,20 +1116,20 @@ population *build_population(fas_optimiser *o,
   return p;
 }
 
-int coin_flip(){
-  return random_number(2);
+int coin_flip(fas_optimiser *o){
+  return random_number_r(&o->rng, 2);
 }
 
 void mutate(fas_optimiser *o, size_t n, size_t *data){
-  size_t i = random_number(n);
+  size_t i = random_number_r(&o->rng, n);
   size_t j;
-  do{ j = random_number(n); } while(i == j);
+  do{ j = random_number_r(&o->rng, n); } while(i == j);
   if(j < i){
     size_t k = i;
     i = j;
     j = k;
   }
-  switch(random_number(5)){
+  switch(random_number_r(&o->rng, 5)){
     case 0:
       reverse(data + i, data + j);  
       break;
@@ -533,7 +1137,7 @@ void mutate(fas_optimiser *o, size_t n, size_t *data){
       swap(data + i, data + j);  
       break;
     case 2:
-      if(coin_flip()){
+      if(coin_flip(o)){
         move_pointer_right(data + i, j - i);
       } else {
         move_pointer_left(data + j, j - i);
@@ -551,21 +1155,23 @@ void mutate(fas_optimiser *o, size_t n, size_t *data){
 
 void improve_population(fas_optimiser *o, population *p, size_t count){
   tournament *t = o->tournament;
-  size_t n = t->size;
-  size_t *data = malloc(n * sizeof(size_t));
+  // Members may be a slice of the whole tournament
+  size_t n = p->members_size;
+  scratch_mark mark = scratch_save(o->scratch);
+  size_t *data = scratch_alloc(o->scratch, n * sizeof(size_t));
 
-  for(size_t i = 0; i < count; i++){
-    size_t *candidate = p->members[random_number(p->population_count)].data;
+  for(size_t i = 0; i < count && !optimiser_stopping(o); i++){
+    size_t *candidate = p->members[random_number_r(&o->rng, p->population_count)].data;
     memcpy(data, candidate, n * sizeof(size_t));
     mutate(o, n, data);
-    double score = score_fas_tournament(t, t->size, candidate);
-    
-    if(!population_contains(p, score, data)){
+    double score = score_fas_tournament(t, n, data);
+
+    if(score > p->members[0].score && !population_contains(p, score, data)){
       population_push(p, score, data);
     }
   }
 
-  free(data);
+  scratch_release(o->scratch, mark);
 }
 
 void population_optimise(fas_optimiser *o,
@@ -579,43 +1185,189 @@ void population_optimise(fas_optimiser *o,
   population_del(p);
 }
 
+// Smoothing is safe to restart from any ordering, so a checkpoint can be
+// taken between any two of its passes
 void comprehensive_smoothing(fas_optimiser *o, size_t n, size_t *results){
   stride_optimise(o, n, results, 11); 
   local_sort(o, n, results);
+  checkpoint_if_due(o, CHECKPOINT_SMOOTHING, 0, n, results, NULL);
   stride_optimise(o, n, results, 13); 
   local_sort(o, n, results);
   reset_optimiser(o);
+  checkpoint_if_due(o, CHECKPOINT_SMOOTHING, 0, n, results, NULL);
+
+  // Each round only revisits the blocks that changed since the last one
+  scratch_mark mark = scratch_save(o->scratch);
+  size_t *last_12 = scratch_alloc(o->scratch, n * sizeof(size_t));
+  size_t *last_7 = scratch_alloc(o->scratch, n * sizeof(size_t));
    
   for(int i = 0; i < 10; i++){
     int changed = 0;
-    changed |= stride_optimise(o, n, results, 12);
-    changed |= stride_optimise(o, n, results, 7);
+    if(i){
+      changed |= stride_optimise_since(o, n, results, 12, last_12);
+      changed |= stride_optimise_since(o, n, results, 7, last_7);
+    } else {
+      changed |= stride_optimise(o, n, results, 12);
+      memcpy(last_12, results, n * sizeof(size_t));
+      changed |= stride_optimise(o, n, results, 7);
+      memcpy(last_7, results, n * sizeof(size_t));
+    }
     changed |= local_sort(o, n, results);
     reset_optimiser(o);
     if(!changed) break;
+    checkpoint_if_due(o, CHECKPOINT_SMOOTHING, 0, n, results, NULL);
     single_move_optimise(o,n,results);
+    checkpoint_if_due(o, CHECKPOINT_SMOOTHING, 0, n, results, NULL);
   } 
+
+  scratch_release(o->scratch, mark);
+}
+
+// Generations are run in slices of this many so there are regular points
+// at which a checkpoint can be taken
+#define CHECKPOINT_GENERATIONS 50
+
+static void run_pipeline(fas_optimiser *o, size_t n, size_t *results, fas_plan *plan, checkpoint *resume){
+  checkpoint_phase phase = resume ? resume->phase : CHECKPOINT_POPULATION;
+
+  if(phase == CHECKPOINT_POPULATION && plan->population){
+    population *p;
+    size_t generations = 0;
+    if(resume && resume->population){
+      p = resume->population;
+      resume->population = NULL;
+      generations = resume->generations;
+    } else {
+      p = build_population(o, n, results, plan->population);
+    }
+
+    while(generations < plan->generations){
+      size_t slice = plan->generations - generations;
+      if(slice > CHECKPOINT_GENERATIONS) slice = CHECKPOINT_GENERATIONS;
+      improve_population(o, p, slice);
+      generations += slice;
+      memcpy(results, fittest_member(p).data, n * sizeof(size_t));
+      checkpoint_if_due(o, CHECKPOINT_POPULATION, generations, n, results, p);
+    }
+    memcpy(results, fittest_member(p).data, n * sizeof(size_t));
+    population_del(p);
+  }
+
+  if(phase == CHECKPOINT_POPULATION){
+    phase = CHECKPOINT_SMOOTHING;
+    checkpoint_if_due(o, phase, 0, n, results, NULL);
+  }
+
+  if(phase == CHECKPOINT_SMOOTHING){
+    if(plan->smoothing) comprehensive_smoothing(o, n, results);
+    phase = CHECKPOINT_WINDOW;
+    checkpoint_if_due(o, phase, 0, n, results, NULL);
+  }
+
+  if(phase == CHECKPOINT_WINDOW){
+    if(plan->window) window_optimise(o, n, results, plan->window < n ? plan->window : n);
+    phase = CHECKPOINT_SORT;
+    checkpoint_if_due(o, phase, 0, n, results, NULL);
+  }
+
+  if(phase == CHECKPOINT_SORT){
+    local_sort(o, n, results);
+    checkpoint_if_due(o, CHECKPOINT_DONE, 0, n, results, NULL);
+  }
+}
+
+// Each condorcet component of the seed ordering is optimised on its own,
+// starting from the one at done. Between components, and during any which
+// run the full pipeline, the whole ordering is checkpointed.
+static void run_split_pipeline(fas_optimiser *o, size_t n, size_t *results, fas_plan *plan, size_t done){
+  unsigned char *clean = condorcet_cuts(o, n - done, results + done);
+  size_t start = done;
+  checkpoint_component(results, start);
+
+  for(size_t p = done; p < n; p++){
+    if(p + 1 < n && !clean[p - done]) continue;
+    size_t length = p + 1 - start;
+    if(length <= plan->exact){
+      table_optimise(o, length, results + start);
+    } else {
+      run_pipeline(o, length, results + start, plan, NULL);
+    }
+    start = p + 1;
+    checkpoint_component(results, start);
+    checkpoint_if_due(o, CHECKPOINT_SPLIT, 0, n - start, results + start, NULL);
+  }
+
+  checkpoint_component(NULL, 0);
+  free(clean);
 }
 
 size_t *optimal_ordering(tournament *t, size_t *results){
   fas_optimiser *o = new_optimiser(t);
   size_t n = t->size;
-  if(results == NULL){
+  FASDEBUG("Scoring with %s kernels\n", score_kernel_name());
+  int given = results != NULL;
+  if(!given){
     results = integer_range(n);
   }
 
-  if(n <= 15){
+  checkpoint_begin();
+  fas_plan plan = plan_ordering(o, n, results, given);
+  if(_enable_fas_tournament_debug) print_plan(stderr, &plan);
+
+  if(n <= plan.exact){
     table_optimise(o, n, results);
-    del_optimiser(o);
-    return results;
+  } else if(plan.split && plan.components > 1){
+    run_split_pipeline(o, n, results, &plan, 0);
+  } else {
+    run_pipeline(o, n, results, &plan, NULL);
   }
 
-  population_optimise(o, n, results, 500, 1000);
-  comprehensive_smoothing(o, n, results);
-  window_optimise(o, n, results, 10);
-  local_sort(o, n, results);
+  del_optimiser(o);
+  checkpoint_end();
+  return results;
+}
+
+size_t *resume_ordering(tournament *t, checkpoint *c){
+  size_t n = t->size;
+  fas_optimiser *o = new_optimiser(t);
+
+  if(c->size != n ||
+     fabs(c->total_weight - o->margins->total_weight) > 1e-9 * (fabs(c->total_weight) + 1)){
+    fail("Checkpoint is for a different tournament");
+  }
+
+  FASDEBUG("Resuming at phase %d after %lu generations with score %f\n",
+           (int)c->phase, (unsigned long)c->generations, c->score);
+
+  size_t *results = copy_items(n, c->ordering);
+  checkpoint_begin();
+
+  // Split runs carry on splitting and unsplit ones don't, so the seed
+  // ordering planning makes is thrown away and we continue from the
+  // checkpointed one.
+  size_t *seed = copy_items(n, c->ordering);
+  fas_plan plan = plan_ordering(o, n, seed, 1);
+  free(seed);
+  plan.split = c->phase == CHECKPOINT_SPLIT;
+  if(_enable_fas_tournament_debug) print_plan(stderr, &plan);
+
+  o->rng = c->rng;
+  if(c->memo){
+    optimisation_table_del(o->opt_table);
+    o->opt_table = c->memo;
+    c->memo = NULL;
+  }
+
+  if(c->phase == CHECKPOINT_SPLIT){
+    run_split_pipeline(o, n, results, &plan, c->done);
+  } else if(n <= plan.exact){
+    table_optimise(o, n, results);
+  } else {
+    run_pipeline(o, n, results, &plan, c);
+  }
 
   del_optimiser(o);
+  checkpoint_end();
   return results;
 }
 
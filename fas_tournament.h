@@ -1,24 +1,98 @@
+#ifndef FAS_TOURNAMENT_H
+#define FAS_TOURNAMENT_H
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+
+// Entries can be stored at reduced precision to cut memory traffic. Reads
+// always come back as doubles and all accumulation is done in double.
+// FIXED16 entries are stored as q with value q * scale, so they can't
+// represent anything larger than 65535 * scale.
+typedef enum {
+  TOURNAMENT_DOUBLE,
+  TOURNAMENT_FLOAT,
+  TOURNAMENT_FIXED16
+} tournament_precision;
 
 typedef struct {
   size_t size;
-  double entries[];
+  tournament_precision precision;
+  double scale;
+  union {
+    double *d;
+    float *f;
+    uint16_t *q;
+  } entries;
 } tournament;
 
+// Binary tournaments start with this magic, followed by the size as a
+// uint64_t and then (uint64_t i, uint64_t j, double x) records until EOF.
+// Records are added together exactly like lines of the text format.
+#define TOURNAMENT_BINARY_MAGIC "FASTOURN"
+
 void enable_fas_tournament_debug(int x);
 
 tournament *new_tournament(size_t n);
+tournament *new_tournament_with_precision(size_t n, tournament_precision precision);
+tournament *convert_tournament(tournament *t, tournament_precision precision);
+tournament *resize_tournament(tournament *t, size_t n);
+int parse_tournament_precision(const char *name, tournament_precision *precision);
+const char *tournament_precision_name(tournament_precision precision);
 void del_tournament(tournament *t);
+size_t tournament_size(tournament *t);
 double tournament_get(tournament *t, size_t i, size_t j);
+// On a FIXED16 tournament a value outside [0, 65535 * scale] is an error
+// for tournament_set, and tournament_try_set returns 0 and leaves the entry
+// alone.
 void tournament_set(tournament *t, size_t i, size_t j, double x);
+int tournament_try_set(tournament *t, size_t i, size_t j, double x);
 
 tournament *read_tournament(FILE *f);
+void write_tournament_binary_header(FILE *f, size_t n);
+void write_tournament_binary_entry(FILE *f, size_t i, size_t j, double x);
+void write_tournament_binary(tournament *t, FILE *f);
+// Same size and every entry reads back the same, whatever the precisions
+int tournaments_equal(tournament *s, tournament *t);
 tournament *normalize_tournament(tournament *t);
+void normalize_tournament_in_place(tournament *t);
+double tournament_max_total(tournament *t);
+double normalized_tournament_get(tournament *t, double max_total, size_t i, size_t j);
 
 double best_score_lower_bound(tournament *t, size_t n, size_t *items);
 double score_fas_tournament(tournament *t, size_t count, size_t *data);
+const char *score_kernel_name();
+// Re-selects the score kernels as if FAS_SIMD were cap (NULL for no cap).
+// Mustn't be called while anything is scoring.
+void set_score_kernel_cap(const char *cap);
 size_t *optimal_ordering(tournament *t, size_t *results);
 
+// Races a portfolio of strategies on every thread for the given number of
+// seconds, sharing the best ordering found so far between them
+size_t *portfolio_ordering(tournament *t, size_t *results, double seconds);
+
+// Orders only as much as is needed to get the first k positions right.
+// If head_size is non NULL it is set to the length of the prefix that was
+// optimised. It is at least k, and nothing after it beats anything in it.
+size_t *top_k_ordering(tournament *t, size_t *results, size_t k, size_t *head_size);
+
+typedef struct {
+  size_t i;
+  size_t j;
+  double delta;
+} tournament_delta;
+
+// Applies deltas to t and repairs previous to suit. Deltas to a FIXED16
+// tournament are an error, as they could overflow its scale. This is a
+// single update of a reoptimiser (see incremental.h), which callers
+// applying a series of updates should keep instead.
+size_t *reoptimise_ordering(tournament *t,
+                            size_t delta_count,
+                            tournament_delta *deltas,
+                            size_t previous_count,
+                            size_t *previous);
+
 size_t tie_starting_from(tournament *t, size_t n, size_t *items, size_t start_index);
 size_t condorcet_boundary_from(tournament *t, size_t n, size_t *items, size_t start_index);
+
+#endif
@@ -1,5 +1,6 @@
 import ctypes
-from ctypes import c_int, c_size_t, c_double, POINTER
+import ctypes.util
+from ctypes import c_int, c_size_t, c_double, c_void_p, POINTER
 import os.path as p
 import numpy as np
 import random
@@ -9,19 +10,62 @@ lib = ctypes.cdll.LoadLibrary(
     p.abspath(p.join(p.dirname(__file__), "..", "fas.so"))
 )
 
+# For the FILE pointers the binary format is read and written through
+libc = ctypes.CDLL(ctypes.util.find_library("c"))
+libc.fopen.restype = c_void_p
+
 
 class Tournament(ctypes.Structure):
     pass
 
 lib.new_tournament.restype = POINTER(Tournament)
 lib.normalize_tournament.restype = POINTER(Tournament)
+lib.convert_tournament.restype = POINTER(Tournament)
+lib.read_tournament.restype = POINTER(Tournament)
+lib.tournament_size.restype = c_size_t
 lib.tournament_get.restype = c_double
+lib.tournament_max_total.restype = c_double
+lib.normalized_tournament_get.restype = c_double
 lib.score_fas_tournament.restype = c_double
 lib.condorcet_boundary_from.restype = c_size_t
 lib.local_sort.restype = c_int
 lib.window_optimise.restype = c_int
 lib.stride_optimise.restype = c_int
 lib.kwik_sort.restype = c_int
+lib.set_plan_overrides.restype = c_int
+lib.tournament_try_set.restype = c_int
+lib.tournaments_equal.restype = c_int
+lib.local_insertion_sort.restype = c_int
+
+
+PRECISIONS = {
+    'double': 0,
+    'float': 1,
+    'fixed16': 2,
+}
+
+
+def set_exact_kernels(enabled):
+    """
+    Turns the specialised exact kernels for small windows on or off, as
+    FAS_EXACT_KERNELS=0 does for the fas binary.
+    """
+    lib.set_exact_kernels_enabled(c_int(1 if enabled else 0))
+
+
+def set_score_kernels(cap=None):
+    """
+    Caps the instruction set used for scoring at 'scalar', 'avx2' or
+    'avx512' as FAS_SIMD does, or removes the cap if cap is None.
+    """
+    lib.set_score_kernel_cap(cap)
+
+
+def open_file(path, mode):
+    f = libc.fopen(path, mode)
+    if not f:
+        raise IOError("Couldn't open %s" % (path,))
+    return c_void_p(f)
 
 
 class Tournament(object):
@@ -42,12 +86,53 @@ class Tournament(object):
             tournament[i, j] = x
         return tournament
 
+    @classmethod
+    def read(cls, path):
+        """
+        Reads path with the C reader, which takes the triples format or the
+        binary format.
+        """
+        t = lib.read_tournament(open_file(path, "rb"))
+        return Tournament(size=lib.tournament_size(t), tournament=t)
+
+    def write_binary(self, path):
+        f = open_file(path, "wb")
+        lib.write_tournament_binary(self.tournament, f)
+        libc.fclose(f)
+
+    def __eq__(self, other):
+        return isinstance(other, Tournament) and bool(
+            lib.tournaments_equal(self.tournament, other.tournament)
+        )
+
+    def __ne__(self, other):
+        return not self == other
+
     def normalize(self):
         return Tournament(
             size=self.size,
             tournament=lib.normalize_tournament(self.tournament)
         )
 
+    def convert(self, precision):
+        """
+        Returns a copy of this tournament with entries stored at the given
+        precision, one of 'double', 'float' or 'fixed16'.
+        """
+        return Tournament(
+            size=self.size,
+            tournament=lib.convert_tournament(
+                self.tournament, c_int(PRECISIONS[precision])
+            )
+        )
+
+    def normalize_in_place(self):
+        lib.normalize_tournament_in_place(self.tournament)
+        return self
+
+    def normalized_view(self):
+        return NormalizedTournament(self)
+
     def __init__(self, size=None, debug=False, tournament=None):
         if size <= 0:
             raise ValueError("Expected positive size, got %d" % size)
@@ -73,7 +158,10 @@ class Tournament(object):
 
     def __setitem__(self, (i, j), x):
         i, j = self.__convertindices(i, j)
-        return lib.tournament_set(self.tournament, i, j, c_double(x))
+        if not lib.tournament_try_set(self.tournament, i, j, c_double(x)):
+            raise ValueError(
+                "%r out of range for this tournament's precision" % (x,)
+            )
 
     def __convertindices(self, i, j):
         if i < 0 or j < 0 or i >= self.size or j >= self.size:
@@ -82,13 +170,52 @@ class Tournament(object):
             )
         return c_size_t(i), c_size_t(j)
 
-    def optimise(self):
-        ordering = np.arange(self.size, dtype=c_size_t)
-        with Optimiser(self, ordering) as optimiser:
-            optimiser.pretty_good_optimisation()
+    def optimise(self, plan=None):
+        """
+        Runs the same planned pipeline as the fas binary. plan optionally
+        overrides the planner's choices, e.g. {'population': 200} or the
+        equivalent "population=200".
+        """
+        if isinstance(plan, dict):
+            plan = ",".join("%s=%d" % kv for kv in sorted(plan.items()))
+        if not lib.set_plan_overrides(plan):
+            raise ValueError("Bad plan %r" % (plan,))
+        try:
+            ordering = np.arange(self.size, dtype=c_size_t)
+            lib.optimal_ordering(
+                self.tournament,
+                ordering.ctypes.data_as(POINTER(c_size_t))
+            )
+        finally:
+            lib.set_plan_overrides(None)
         return Optimisation(self, ordering)
 
 
+class NormalizedTournament(object):
+    """
+    Read only view of the normalized form of a tournament. Only the scale
+    factor is stored and entries are computed on access, so unlike
+    Tournament.normalize() this doesn't need a second n x n matrix.
+    """
+
+    def __init__(self, tournament):
+        self.tournament = tournament
+        self.size = tournament.size
+        self.max_total = lib.tournament_max_total(tournament.tournament)
+
+    def __getitem__(self, (i, j)):
+        if i < 0 or j < 0 or i >= self.size or j >= self.size:
+            raise ValueError(
+                "%d, %d out of bounds [0, %d)" % (i, j, self.size)
+            )
+        return lib.normalized_tournament_get(
+            self.tournament.tournament,
+            c_double(self.max_total),
+            c_size_t(i),
+            c_size_t(j)
+        )
+
+
 class Optimiser(object):
     def __init__(self, tournament, items):
         self.tournament = tournament
@@ -99,7 +226,7 @@ class Optimiser(object):
     @property
     def normalized_tournament(self):
         if self.__normalized_tournament is None:
-            self.__normalized_tournament = self.tournament.normalize()
+            self.__normalized_tournament = self.tournament.normalized_view()
         return self.__normalized_tournament
 
     def reset(self):
@@ -250,6 +377,9 @@ class Optimiser(object):
     def local_sort(self):
         return self.__optimise(lib.local_sort)
 
+    def local_insertion_sort(self):
+        return self.__optimise(lib.local_insertion_sort)
+
     def window_optimise(self, window=5):
         return self.__optimise(lib.window_optimise, window)
 
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ballots.h"
+#include "parallel.h"
+
+static void usage(){
+  fprintf(stderr, "Usage: fromvotes [-b] [-j threads] [-c candidates_file] [inputfile]\n");
+  exit(1);
+}
+
+int main(int argc, char **argv){
+  int binary = 0;
+  char *candidates_file = NULL;
+  char *input_file = NULL;
+
+  for(int i = 1; i < argc; i++){
+    if(!strcmp(argv[i], "-b")){
+      binary = 1;
+    } else if(!strcmp(argv[i], "-j")){
+      if(++i >= argc) usage();
+      set_parallel_thread_count(strtoul(argv[i], NULL, 0));
+    } else if(!strcmp(argv[i], "-c")){
+      if(++i >= argc) usage();
+      candidates_file = argv[i];
+    } else if(argv[i][0] == '-' || input_file){
+      usage();
+    } else {
+      input_file = argv[i];
+    }
+  }
+
+  FILE *argf = stdin;
+  if(input_file){
+    argf = fopen(input_file, "r");
+    if(!argf){
+      fprintf(stderr, "Unable to open file %s for reading\n", input_file);
+      exit(1);
+    }
+  }
+
+  ballot_aggregator *a = ballot_aggregator_new(0);
+  ballot_aggregator_read(a, argf);
+  if(argf != stdin) fclose(argf);
+
+  if(!a->candidate_count){
+    fprintf(stderr, "No ballots found\n");
+    exit(1);
+  }
+
+  if(candidates_file){
+    FILE *cf = fopen(candidates_file, "w");
+    if(!cf){
+      fprintf(stderr, "Unable to open file %s for writing\n", candidates_file);
+      exit(1);
+    }
+    ballot_aggregator_write_candidates(a, cf);
+    fclose(cf);
+  }
+
+  if(binary){
+    ballot_aggregator_write_binary(a, stdout);
+  } else {
+    ballot_aggregator_write_triples(a, stdout);
+  }
+
+  ballot_aggregator_del(a);
+  return 0;
+}
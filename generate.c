@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "generator.h"
+
+static void usage(){
+  fprintf(stderr, "Usage: generate [-b] [-s seed] [-d density] [-e noise] [-t ties] [-k blocks] [-m voters [-l ballot_size] [-p phi]] [-o planted_file] size\n");
+  exit(1);
+}
+
+static double parse_probability(char *arg){
+  char *end;
+  double x = strtod(arg, &end);
+  if(*end || x < 0 || x > 1) usage();
+  return x;
+}
+
+int main(int argc, char **argv){
+  generator_options g;
+  generator_options_init(&g, 0);
+  g.seed = time(NULL) ^ getpid();
+  char *planted_file = NULL;
+  int have_size = 0;
+
+  for(int i = 1; i < argc; i++){
+    if(!strcmp(argv[i], "-b")){
+      g.binary = 1;
+    } else if(i + 1 >= argc && argv[i][0] == '-'){
+      usage();
+    } else if(!strcmp(argv[i], "-s")){
+      g.seed = strtoull(argv[++i], NULL, 0);
+    } else if(!strcmp(argv[i], "-d")){
+      g.density = parse_probability(argv[++i]);
+    } else if(!strcmp(argv[i], "-e")){
+      g.noise = parse_probability(argv[++i]);
+    } else if(!strcmp(argv[i], "-t")){
+      g.ties = parse_probability(argv[++i]);
+    } else if(!strcmp(argv[i], "-k")){
+      g.blocks = strtoul(argv[++i], NULL, 10);
+      if(!g.blocks) usage();
+    } else if(!strcmp(argv[i], "-m")){
+      g.voters = strtoul(argv[++i], NULL, 10);
+    } else if(!strcmp(argv[i], "-l")){
+      g.ballot_size = strtoul(argv[++i], NULL, 10);
+    } else if(!strcmp(argv[i], "-p")){
+      g.phi = parse_probability(argv[++i]);
+    } else if(!strcmp(argv[i], "-o")){
+      planted_file = argv[++i];
+    } else if(argv[i][0] == '-' || have_size){
+      usage();
+    } else {
+      g.size = strtoul(argv[i], NULL, 10);
+      have_size = 1;
+    }
+  }
+
+  if(!g.size) usage();
+
+  setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+  generated_tournament result = generate_tournament(&g, stdout);
+  fflush(stdout);
+
+  // Same shape as the output of fas, so it can be passed to --previous
+  if(planted_file){
+    FILE *pf = fopen(planted_file, "w");
+    if(!pf){
+      fprintf(stderr, "Unable to open file %s for writing\n", planted_file);
+      exit(1);
+    }
+    fprintf(pf, "Score: %f\n", result.planted_score);
+    for(size_t i = 0; i < g.size; i++) fprintf(pf, " %lu", (unsigned long)result.planted[i]);
+    fprintf(pf, "\n");
+    fclose(pf);
+  }
+
+  free(result.planted);
+  return 0;
+}
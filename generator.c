@@ -0,0 +1,165 @@
+#include "generator.h"
+#include "permutations.h"
+#include <math.h>
+#include <string.h>
+
+void generator_options_init(generator_options *g, size_t n){
+  g->size = n;
+  g->density = 1.0;
+  g->noise = 0.1;
+  g->ties = 0.0;
+  g->blocks = 1;
+  g->voters = 0;
+  g->ballot_size = 10;
+  g->phi = 0.8;
+  g->seed = 0;
+  g->binary = 0;
+}
+
+static void emit(generator_options *g, FILE *out, generated_tournament *result, size_t i, size_t j){
+  if(g->binary){
+    write_tournament_binary_entry(out, i, j, 1.0);
+  } else {
+    fprintf(out, "%lu %lu 1\n", (unsigned long)i, (unsigned long)j);
+  }
+  result->records++;
+}
+
+// Number of unweighted pairs before the next weighted one
+static size_t next_skip(generator_options *g, random_state *r, double log_miss){
+  if(g->density >= 1) return 0;
+  double skip = floor(log(1 - random_double_r(r)) / log_miss);
+  return skip < (double)(SIZE_MAX / 2) ? (size_t)skip : SIZE_MAX / 2;
+}
+
+static void emit_pair(generator_options *g, random_state *r, FILE *out, generated_tournament *result, size_t a, size_t b){
+  size_t n = g->size;
+  size_t x = result->planted[a];
+  size_t y = result->planted[b];
+
+  if(a * g->blocks / n != b * g->blocks / n){
+    emit(g, out, result, x, y);
+    result->planted_score += 1;
+  } else if(random_double_r(r) < g->ties){
+    emit(g, out, result, x, y);
+    emit(g, out, result, y, x);
+    result->planted_score += 1;
+  } else if(random_double_r(r) < g->noise){
+    emit(g, out, result, y, x);
+  } else {
+    emit(g, out, result, x, y);
+    result->planted_score += 1;
+  }
+}
+
+// Walks the pairs a < b of planted positions row by row, jumping straight
+// from one weighted pair to the next
+static void generate_pairs(generator_options *g, random_state *r, FILE *out, generated_tournament *result){
+  size_t n = g->size;
+  if(n < 2 || g->density <= 0) return;
+
+  double log_miss = g->density < 1 ? log(1 - g->density) : 0;
+  size_t skip = next_skip(g, r, log_miss);
+
+  for(size_t a = 0; a + 1 < n; a++){
+    size_t b = a + 1;
+    for(;;){
+      if(skip >= n - b){
+        skip -= n - b;
+        break;
+      }
+      b += skip;
+      emit_pair(g, r, out, result, a, b);
+      b++;
+      skip = next_skip(g, r, log_miss);
+    }
+  }
+}
+
+static int compare_positions(const void *xx, const void *yy){
+  size_t x = *(const size_t*)xx;
+  size_t y = *(const size_t*)yy;
+  if(x < y) return -1;
+  if(x > y) return 1;
+  return 0;
+}
+
+// How far before the end of a ranking of length i the next item goes in
+// the repeated insertion model, P(d) proportional to phi^d for d in [0, i]
+static size_t insertion_offset(generator_options *g, random_state *r, size_t i){
+  if(g->phi <= 0) return 0;
+  if(g->phi >= 1) return random_number_r(r, i + 1);
+
+  double u = random_double_r(r);
+  double d = floor(log(1 - u * (1 - pow(g->phi, i + 1))) / log(g->phi));
+  return d < i ? (size_t)d : i;
+}
+
+static void generate_votes(generator_options *g, random_state *r, FILE *out, generated_tournament *result){
+  size_t n = g->size;
+  size_t s = g->ballot_size < n ? g->ballot_size : n;
+  unsigned char *chosen = calloc(n, 1);
+  size_t *positions = malloc(s * sizeof(size_t));
+  size_t *vote = malloc(s * sizeof(size_t));
+
+  for(size_t v = 0; v < g->voters; v++){
+    for(size_t k = 0; k < s; k++){
+      size_t p;
+      do p = random_number_r(r, n); while(chosen[p]);
+      chosen[p] = 1;
+      positions[k] = p;
+    }
+    qsort(positions, s, sizeof(size_t), compare_positions);
+
+    for(size_t i = 0; i < s; i++){
+      size_t at = i - insertion_offset(g, r, i);
+      memmove(vote + at + 1, vote + at, (i - at) * sizeof(size_t));
+      vote[at] = positions[i];
+    }
+
+    for(size_t k = 0; k < s; k++){
+      for(size_t l = k + 1; l < s; l++){
+        emit(g, out, result, result->planted[vote[k]], result->planted[vote[l]]);
+        if(vote[k] < vote[l]) result->planted_score += 1;
+      }
+      chosen[vote[k]] = 0;
+    }
+  }
+
+  free(vote);
+  free(positions);
+  free(chosen);
+}
+
+generated_tournament generate_tournament(generator_options *g, FILE *out){
+  size_t n = g->size;
+  random_state r;
+  random_seed(&r, g->seed);
+
+  generated_tournament result;
+  result.planted = malloc(n * sizeof(size_t));
+  result.planted_score = 0;
+  result.records = 0;
+
+  for(size_t i = 0; i < n; i++) result.planted[i] = i;
+  for(size_t i = n; i > 1; i--){
+    size_t j = random_number_r(&r, i);
+    size_t x = result.planted[i - 1];
+    result.planted[i - 1] = result.planted[j];
+    result.planted[j] = x;
+  }
+
+  if(g->binary){
+    write_tournament_binary_header(out, n);
+  } else {
+    fprintf(out, "%lu\n", (unsigned long)n);
+  }
+
+  if(g->voters){
+    generate_votes(g, &r, out, &result);
+  } else {
+    generate_pairs(g, &r, out, &result);
+  }
+
+  return result;
+}
@@ -0,0 +1,50 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "fas_tournament.h"
+
+// Synthetic tournaments with a known planted ordering, for benchmarking at
+// sizes beyond the test cases.
+//
+// Output is streamed as it is generated, in the triple format or the binary
+// format, so the generator itself needs O(n) memory whatever the density.
+//
+// In the default pair model each pair is given weight with probability
+// density, skipping geometrically between weighted pairs so sparse
+// tournaments cost time proportional to their size. A weighted pair is a
+// tie (weight 1 both ways) with probability ties, and otherwise has weight
+// 1 against the planted order with probability noise and with it the rest
+// of the time. With blocks > 1 the planted order is cut into that many
+// equal blocks and pairs across blocks always follow it, so each block is a
+// condorcet component.
+//
+// If voters is non zero the Mallows model is used instead: each voter ranks
+// ballot_size random items, with the ranking drawn from a Mallows
+// distribution centred on the planted order with dispersion phi, and adds 1
+// to W_ij for each i ranked above j. phi = 0 agrees with the planted order
+// and phi = 1 is uniformly random.
+typedef struct {
+  size_t size;
+  double density;
+  double noise;
+  double ties;
+  size_t blocks;
+  size_t voters;
+  size_t ballot_size;
+  double phi;
+  uint64_t seed;
+  int binary;
+} generator_options;
+
+typedef struct {
+  // planted[k] is the item at position k
+  size_t *planted;
+  double planted_score;
+  size_t records;
+} generated_tournament;
+
+void generator_options_init(generator_options *g, size_t n);
+generated_tournament generate_tournament(generator_options *g, FILE *out);
+#endif
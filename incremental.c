@@ -0,0 +1,256 @@
+#include "incremental.h"
+#include <string.h>
+
+// Warm started re-optimisation after a batch of weight changes.
+//
+// Only the items whose weights changed (or which are new) are treated as
+// suspect. Each is moved to its best single position, then window passes
+// are run over the neighbourhoods they end up in. If too much of the
+// tournament was touched, or the repaired ordering captures noticeably
+// less of the total weight than the previous one did, we fall back to a
+// full solve seeded with the repaired ordering.
+
+#define REOPTIMISE_ROUNDS 3
+#define REOPTIMISE_RADIUS 12
+#define REOPTIMISE_WINDOW 10
+#define REOPTIMISE_MAX_TOUCHED 0.25
+#define REOPTIMISE_MAX_DRIFT 0.001
+
+static void index_positions(reoptimiser *r, size_t start, size_t end){
+  for(size_t i = start; i < end; i++) r->position[r->ordering[i]] = i;
+}
+
+// Weight of every pair of distinct items, whichever way round
+static double total_weight(tournament *t, size_t n, size_t *items){
+  double total = 0.0;
+  for(size_t i = 0; i < n; i++){
+    for(size_t j = i + 1; j < n; j++){
+      total += tournament_get(t, items[i], items[j]) + tournament_get(t, items[j], items[i]);
+    }
+  }
+  return total;
+}
+
+reoptimiser *reoptimiser_new(tournament *t, size_t previous_count, size_t *previous){
+  size_t n = t->size;
+  reoptimiser *r = malloc(sizeof(reoptimiser));
+  r->optimiser = new_optimiser(t);
+  r->ordering = malloc(sizeof(size_t) * (n ? n : 1));
+  r->position = malloc(sizeof(size_t) * (n ? n : 1));
+  for(size_t x = 0; x < n; x++) r->position[x] = REOPTIMISER_UNPLACED;
+
+  r->count = 0;
+  for(size_t k = 0; k < previous_count; k++){
+    size_t x = previous[k];
+    if(x >= n || r->position[x] != REOPTIMISER_UNPLACED) continue;
+    r->position[x] = r->count;
+    r->ordering[r->count++] = x;
+  }
+
+  r->score = score_fas_tournament(t, r->count, r->ordering);
+  r->total = r->count == n ? r->optimiser->margins->total_weight : total_weight(t, r->count, r->ordering);
+  return r;
+}
+
+void reoptimiser_del(reoptimiser *r){
+  del_optimiser(r->optimiser);
+  free(r->ordering);
+  free(r->position);
+  free(r);
+}
+
+// Memoised orderings and beater lists were worked out from the old margins
+static void forget_margins(fas_optimiser *o){
+  reset_optimiser(o);
+  beater_lists_del(o->beaters);
+  o->beaters = NULL;
+  o->beaters_checked = 0;
+}
+
+// Margin sum over the pairs of items[0..n) which are both in the ordering
+// the update started with
+static double kept_margin_score(fas_optimiser *o, size_t n, size_t *items, unsigned char *fresh){
+  double score = 0.0;
+  for(size_t i = 0; i < n; i++){
+    if(fresh[items[i]]) continue;
+    for(size_t j = i + 1; j < n; j++){
+      if(!fresh[items[j]]) score += margin_matrix_get(o->margins, items[i], items[j]);
+    }
+  }
+  return score;
+}
+
+// Items shift as others move, so walk by item rather than position. Each
+// move only reorders the moving item against those it passes, so only
+// those pairs change the score.
+static void move_touched_items(reoptimiser *r, unsigned char *touched, unsigned char *fresh){
+  fas_optimiser *o = r->optimiser;
+  size_t n = r->count;
+  size_t *items = r->ordering;
+
+  for(size_t round = 0; round < REOPTIMISE_ROUNDS; round++){
+    int changed = 0;
+    for(size_t x = 0; x < n; x++){
+      if(!touched[x]) continue;
+      size_t from = r->position[x];
+      if(!best_single_move(o, n, items, from)) continue;
+      changed = 1;
+
+      size_t to = from;
+      for(size_t d = 1; items[to] != x; d++){
+        if(from >= d && items[from - d] == x) to = from - d;
+        else if(from + d < n && items[from + d] == x) to = from + d;
+      }
+
+      size_t lo = to < from ? to : from;
+      size_t hi = to < from ? from : to;
+      if(!fresh[x]){
+        for(size_t i = lo; i <= hi; i++){
+          size_t y = items[i];
+          if(y == x || fresh[y]) continue;
+          r->score += to < from ? margin_matrix_get(o->margins, x, y) : margin_matrix_get(o->margins, y, x);
+        }
+      }
+      index_positions(r, lo, hi + 1);
+    }
+    if(!changed) break;
+  }
+}
+
+static void repair_touched_regions(reoptimiser *r, unsigned char *touched, unsigned char *fresh){
+  fas_optimiser *o = r->optimiser;
+  size_t n = r->count;
+  size_t *items = r->ordering;
+  unsigned char *in_region = calloc(n ? n : 1, 1);
+
+  for(size_t x = 0; x < n; x++){
+    if(!touched[x]) continue;
+    size_t i = r->position[x];
+    size_t start = i > REOPTIMISE_RADIUS ? i - REOPTIMISE_RADIUS : 0;
+    size_t end = i + REOPTIMISE_RADIUS + 1 < n ? i + REOPTIMISE_RADIUS + 1 : n;
+    memset(in_region + start, 1, end - start);
+  }
+
+  size_t i = 0;
+  while(i < n){
+    if(!in_region[i]){
+      i++;
+      continue;
+    }
+    size_t start = i;
+    while(i < n && in_region[i]) i++;
+    size_t length = i - start;
+    double before = kept_margin_score(o, length, items + start, fresh);
+    window_optimise(o, length, items + start, length < REOPTIMISE_WINDOW ? length : REOPTIMISE_WINDOW);
+    r->score += (kept_margin_score(o, length, items + start, fresh) - before) / 2;
+    index_positions(r, start, i);
+  }
+
+  free(in_region);
+}
+
+// Adds the pairs of each new item with everything else to the score and
+// total, counting pairs of two new items once
+static void count_fresh_items(reoptimiser *r, unsigned char *fresh){
+  tournament *t = r->optimiser->tournament;
+  size_t n = r->count;
+
+  for(size_t x = 0; x < n; x++){
+    if(!fresh[x]) continue;
+    for(size_t y = 0; y < n; y++){
+      if(y == x || (fresh[y] && y < x)) continue;
+      double wxy = tournament_get(t, x, y);
+      double wyx = tournament_get(t, y, x);
+      r->total += wxy + wyx;
+      r->score += r->position[x] < r->position[y] ? wxy : wyx;
+    }
+  }
+}
+
+void reoptimiser_update(reoptimiser *r, size_t delta_count, tournament_delta *deltas){
+  fas_optimiser *o = r->optimiser;
+  tournament *t = o->tournament;
+  size_t n = t->size;
+
+  // Weights would clamp at the largest fixed point value
+  if(delta_count && t->precision == TOURNAMENT_FIXED16){
+    fprintf(stderr, "Deltas can't be applied to a fixed16 tournament\n");
+    exit(1);
+  }
+
+  unsigned char *touched = calloc(n ? n : 1, 1);
+  unsigned char *fresh = calloc(n ? n : 1, 1);
+
+  // Quality is the fraction of the available weight an ordering agrees
+  // with. It is only measured over the items already in the ordering,
+  // before the deltas for the previous ordering and after them for the
+  // repaired one, as the previous ordering says nothing about where new
+  // items go. Each delta moves the score and total by its own size.
+  double previous_quality = r->total > 0 ? r->score / r->total : 1.0;
+
+  for(size_t k = 0; k < delta_count; k++){
+    size_t i = deltas[k].i;
+    size_t j = deltas[k].j;
+    if(i >= n || j >= n){
+      fprintf(stderr, "Delta for %lu, %lu out of bounds\n", (unsigned long)i, (unsigned long)j);
+      exit(1);
+    }
+    double old_value = tournament_get(t, i, j);
+    double new_value = old_value + deltas[k].delta;
+    if(new_value < 0) new_value = 0;
+    tournament_set(t, i, j, new_value);
+    double change = tournament_get(t, i, j) - old_value;
+    margin_matrix_add(o->margins, i, j, change);
+    touched[i] = 1;
+    touched[j] = 1;
+
+    if(i != j && r->position[i] != REOPTIMISER_UNPLACED && r->position[j] != REOPTIMISER_UNPLACED){
+      r->total += change;
+      if(r->position[i] < r->position[j]) r->score += change;
+    }
+  }
+  if(delta_count) forget_margins(o);
+
+  for(size_t x = 0; x < n; x++){
+    if(r->position[x] != REOPTIMISER_UNPLACED) continue;
+    touched[x] = 1;
+    fresh[x] = 1;
+    r->position[x] = r->count;
+    r->ordering[r->count++] = x;
+  }
+
+  size_t touched_count = 0;
+  for(size_t x = 0; x < n; x++) touched_count += touched[x];
+
+  move_touched_items(r, touched, fresh);
+  repair_touched_regions(r, touched, fresh);
+
+  double quality = r->total > 0 ? r->score / r->total : 1.0;
+
+  FASDEBUG("Reoptimised %lu touched items: quality %f -> %f\n",
+           (unsigned long)touched_count, previous_quality, quality);
+
+  count_fresh_items(r, fresh);
+  free(touched);
+  free(fresh);
+
+  if(touched_count > n * REOPTIMISE_MAX_TOUCHED || quality < previous_quality - REOPTIMISE_MAX_DRIFT){
+    FASDEBUG("Falling back to a full solve\n");
+    optimal_ordering(t, r->ordering);
+    r->score = score_fas_tournament(t, n, r->ordering);
+    index_positions(r, 0, n);
+  }
+}
+
+size_t *reoptimise_ordering(tournament *t,
+                            size_t delta_count,
+                            tournament_delta *deltas,
+                            size_t previous_count,
+                            size_t *previous){
+  reoptimiser *r = reoptimiser_new(t, previous_count, previous);
+  reoptimiser_update(r, delta_count, deltas);
+  size_t *results = r->ordering;
+  r->ordering = NULL;
+  reoptimiser_del(r);
+  return results;
+}
@@ -0,0 +1,41 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "fas_optimiser.h"
+
+// Keeps an ordering of a tournament up to date through a series of weight
+// changes.
+//
+// The optimiser and its margin matrix live as long as the reoptimiser, and
+// each update patches the margins in place rather than rebuilding them.
+// The score of the ordering and the total weight of its pairs are kept up
+// to date from the deltas and from the moves the repair makes, so an update
+// costs time in proportion to the items it touches, each of which is
+// checked against the whole ordering once per round, rather than n^2.
+// Only creating a reoptimiser and falling back to a full solve pay n^2.
+//
+// The tournament can't be resized under a reoptimiser.
+
+#define REOPTIMISER_UNPLACED ((size_t)-1)
+
+typedef struct {
+  fas_optimiser *optimiser;
+  size_t count;
+  size_t *ordering;
+  // position[x] is the index of x in ordering, or REOPTIMISER_UNPLACED
+  size_t *position;
+  // Score of ordering, and the weight of every pair of distinct items in it
+  // whichever way round
+  double score;
+  double total;
+} reoptimiser;
+
+// Starts from previous, dropping entries that are out of range or repeated.
+// Items missing from it are inserted by the first update.
+reoptimiser *reoptimiser_new(tournament *t, size_t previous_count, size_t *previous);
+void reoptimiser_del(reoptimiser *r);
+
+// Applies deltas to the tournament and repairs the ordering to suit. After
+// this the ordering holds every item of the tournament.
+void reoptimiser_update(reoptimiser *r, size_t delta_count, tournament_delta *deltas);
+#endif
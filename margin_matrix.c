@@ -0,0 +1,112 @@
+#include "margin_matrix.h"
+#include "parallel.h"
+
+#define MARGIN_BLOCK 64
+
+typedef struct {
+  tournament *tournament;
+  margin_matrix *matrix;
+  double *band_totals;
+} margin_job;
+
+// Sets the entry at index to W_ij - W_ji and returns W_ij + W_ji
+static inline double store_margin(margin_matrix *m, size_t index, tournament *t, size_t i, size_t j){
+  double wij = tournament_get(t, i, j);
+  double wji = tournament_get(t, j, i);
+  double margin = i == j ? 0.0 : wij - wji;
+  if(m->precision == TOURNAMENT_FLOAT){
+    m->margins.f[index] = (float)margin;
+  } else {
+    m->margins.d[index] = margin;
+  }
+  return wij + wji;
+}
+
+// Fills in the rows of one band, tile by tile so the transposed reads of
+// W_ji stay in cache.
+static void fill_band(void *context, size_t band){
+  margin_job *job = context;
+  tournament *t = job->tournament;
+  margin_matrix *m = job->matrix;
+  size_t n = m->size;
+  double total = 0.0;
+
+  size_t i_start = band * MARGIN_BLOCK;
+  size_t i_end = i_start + MARGIN_BLOCK < n ? i_start + MARGIN_BLOCK : n;
+
+  for(size_t j_start = i_start; j_start < n; j_start += MARGIN_BLOCK){
+    size_t j_end = j_start + MARGIN_BLOCK < n ? j_start + MARGIN_BLOCK : n;
+    for(size_t i = i_start; i < i_end; i++){
+      size_t row = m->row_offsets[i];
+      if(j_start <= i) store_margin(m, row + i, t, i, i);
+      for(size_t j = (j_start > i ? j_start : i + 1); j < j_end; j++){
+        total += store_margin(m, row + j, t, i, j);
+      }
+    }
+  }
+
+  job->band_totals[band] = total;
+}
+
+margin_matrix *margin_matrix_new(tournament *t){
+  size_t n = t->size;
+  margin_matrix *m = malloc(sizeof(margin_matrix));
+  m->size = n;
+  m->precision = t->precision == TOURNAMENT_DOUBLE ? TOURNAMENT_DOUBLE : TOURNAMENT_FLOAT;
+  m->row_offsets = malloc(sizeof(size_t) * (n ? n : 1));
+  size_t entry_size = m->precision == TOURNAMENT_FLOAT ? sizeof(float) : sizeof(double);
+  m->margins.d = malloc(entry_size * (n ? n * (n + 1) / 2 : 1));
+
+  // Row i holds the n - i entries for j >= i, indexed directly by j
+  size_t start = 0;
+  for(size_t i = 0; i < n; i++){
+    m->row_offsets[i] = start - i;
+    start += n - i;
+  }
+
+  size_t bands = (n + MARGIN_BLOCK - 1) / MARGIN_BLOCK;
+  margin_job job;
+  job.tournament = t;
+  job.matrix = m;
+  job.band_totals = malloc(sizeof(double) * (bands ? bands : 1));
+
+  parallel_for(bands, fill_band, &job);
+
+  m->total_weight = 0.0;
+  for(size_t b = 0; b < bands; b++) m->total_weight += job.band_totals[b];
+  free(job.band_totals);
+
+  return m;
+}
+
+void margin_matrix_del(margin_matrix *m){
+  free(m->row_offsets);
+  free(m->margins.d);
+  free(m);
+}
+
+void margin_matrix_add(margin_matrix *m, size_t i, size_t j, double delta){
+  if(i == j) return;
+  size_t lo = i < j ? i : j;
+  size_t hi = i < j ? j : i;
+  size_t index = m->row_offsets[lo] + hi;
+  double margin = i < j ? delta : -delta;
+  if(m->precision == TOURNAMENT_FLOAT){
+    m->margins.f[index] += (float)margin;
+  } else {
+    m->margins.d[index] += margin;
+  }
+  m->total_weight += delta;
+}
+
+double margin_score(margin_matrix *m, size_t count, size_t *data){
+  double score = 0.0;
+
+  for(size_t i = 0; i < count; i++){
+    for(size_t j = i + 1; j < count; j++){
+      score += margin_matrix_get(m, data[i], data[j]);
+    }
+  }
+
+  return score;
+}
@@ -0,0 +1,65 @@
+#ifndef MARGIN_MATRIX_H
+#define MARGIN_MATRIX_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "fas_tournament.h"
+
+// Antisymmetric view of a tournament for the optimisers.
+//
+// Only M_ij = W_ij - W_ji for i <= j is stored, packed row by row into an
+// upper triangle (with a zero diagonal), so comparing or moving a pair costs a single load rather
+// than a load from W_ij and a column strided one from W_ji. Because
+//
+//   score = (sum_{i < j} (W_ij + W_ji) + sum_{p_i < p_j} M_ij) / 2
+//
+// and the first sum doesn't depend on the ordering, margin sums can be
+// compared directly whenever two orderings of the same items are compared.
+//
+// Margins are stored as doubles for double tournaments and as floats
+// otherwise, so the n(n + 1) / 2 entries take half the tournament's memory
+// for double and float and as much as the tournament for FIXED16 (whose
+// margins are differences of two 16-bit values and need 17 bits).
+
+typedef struct {
+  size_t size;
+  double total_weight;
+  // TOURNAMENT_DOUBLE or TOURNAMENT_FLOAT
+  tournament_precision precision;
+  size_t *row_offsets;
+  union {
+    double *d;
+    float *f;
+  } margins;
+} margin_matrix;
+
+margin_matrix *margin_matrix_new(tournament *t);
+void margin_matrix_del(margin_matrix *m);
+
+double margin_score(margin_matrix *m, size_t count, size_t *data);
+
+// Patches the matrix for delta having been added to W_ij
+void margin_matrix_add(margin_matrix *m, size_t i, size_t j, double delta);
+
+// M_lo,hi for lo <= hi
+static inline double margin_matrix_entry(margin_matrix *m, size_t lo, size_t hi){
+  size_t index = m->row_offsets[lo] + hi;
+  if(m->precision == TOURNAMENT_FLOAT) return m->margins.f[index];
+  return m->margins.d[index];
+}
+
+// Item ids are effectively random in the optimisers' inner loops, so this
+// avoids branching on which side of the diagonal (i, j) falls.
+static inline double margin_matrix_get(margin_matrix *m, size_t i, size_t j){
+  size_t lo = i < j ? i : j;
+  size_t hi = i < j ? j : i;
+  double x = margin_matrix_entry(m, lo, hi);
+
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(double));
+  bits ^= (uint64_t)(i > j) << 63;
+  memcpy(&x, &bits, sizeof(double));
+  return x;
+}
+#endif
@@ -40,10 +40,15 @@ size_t *clone_set(size_t length, size_t *x){
 }
 
 optimisation_table *optimisation_table_new(){
+  return optimisation_table_new_with_length(DEFAULT_TABLE_SIZE);
+}
+
+// length must be a power of two
+optimisation_table *optimisation_table_new_with_length(size_t length){
   optimisation_table *result = malloc(sizeof(optimisation_table));
   result->occupancy = 0;
-  result->length=DEFAULT_TABLE_SIZE;
-  result->entries = calloc(DEFAULT_TABLE_SIZE, sizeof(ot_entry));
+  result->length = length;
+  result->entries = calloc(length, sizeof(ot_entry));
   return result;
 }
 
@@ -79,7 +84,7 @@ ot_entry *optimisation_table_lookup_internal(optimisation_table *ot, size_t leng
         ce->length = length;
         ce->hash = h;
         ce->data = (must_copy ? clone_set(length, data) : data);
-        ce->value = -1;
+        ce->value = OT_UNKNOWN;
         ot->occupancy++;
         return ce;
       }
@@ -1,5 +1,13 @@
+#ifndef OPTIMISATION_TABLE_H
+#define OPTIMISATION_TABLE_H
+
 #include <stdlib.h>
 #include <stdint.h>
+#include <math.h>
+
+// Value of an entry nobody has computed yet. Values are margin sums, which
+// can be negative, so this has to sit below anything a real one could be.
+#define OT_UNKNOWN (-HUGE_VAL)
 
 typedef struct{
   uint64_t hash;
@@ -16,5 +24,10 @@ typedef struct {
 
 
 optimisation_table *optimisation_table_new();
+optimisation_table *optimisation_table_new_with_length(size_t length);
 void optimisation_table_del(optimisation_table *ot);
 ot_entry *optimisation_table_lookup(optimisation_table *ot, size_t length, size_t *data);
+
+// Order independent hash of a set of items
+uint64_t set_hash(size_t length, size_t *x);
+#endif
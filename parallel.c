@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 200809L
+#include "parallel.h"
+#include <pthread.h>
+#include <unistd.h>
+
+static size_t _parallel_thread_count = 0;
+
+// Set on threads that are running a parallel_for body, so that a nested
+// parallel_for (e.g. scoring from inside a portfolio worker) runs inline
+// rather than multiplying the number of threads.
+static __thread int _inside_parallel_for = 0;
+
+void set_parallel_thread_count(size_t n){
+  _parallel_thread_count = n;
+}
+
+// An explicit setting wins, then FAS_THREADS, then the number of online CPUs
+size_t parallel_thread_count(){
+  if(_parallel_thread_count) return _parallel_thread_count;
+
+  char *env = getenv("FAS_THREADS");
+  if(env){
+    size_t n = strtoul(env, NULL, 0);
+    if(n) return n;
+  }
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return cpus > 0 ? (size_t)cpus : 1;
+}
+
+typedef struct {
+  size_t tasks;
+  size_t next_task;
+  parallel_body body;
+  void *context;
+} parallel_job;
+
+static void *parallel_worker(void *x){
+  parallel_job *job = x;
+  int was_inside = _inside_parallel_for;
+  _inside_parallel_for = 1;
+  for(;;){
+    size_t task = __sync_fetch_and_add(&job->next_task, 1);
+    if(task >= job->tasks) break;
+    job->body(job->context, task);
+  }
+  _inside_parallel_for = was_inside;
+  return NULL;
+}
+
+// Helper threads are started the first time they are needed and then sleep
+// between jobs, so that passes which call parallel_for once per sweep or
+// generation don't pay for creating and joining threads every time.
+//
+// Each job bumps the generation and says how many helpers it wants. A
+// helper that wakes after the caller has finished the job finds none wanted
+// and goes back to sleep.
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  size_t threads;
+  size_t generation;
+  size_t wanted;
+  size_t running;
+  parallel_job *job;
+} parallel_pool;
+
+static parallel_pool pool = {
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+  0, 0, 0, 0, NULL
+};
+
+// Only one parallel_for at a time can use the pool. Any others running
+// concurrently on other threads do their work inline.
+static pthread_mutex_t pool_owner = PTHREAD_MUTEX_INITIALIZER;
+
+static void *pool_helper(void *x){
+  (void)x;
+  pthread_mutex_lock(&pool.lock);
+  size_t seen = pool.generation;
+  for(;;){
+    while(pool.generation == seen) pthread_cond_wait(&pool.wake, &pool.lock);
+    seen = pool.generation;
+    if(!pool.wanted) continue;
+    pool.wanted--;
+    pool.running++;
+    parallel_job *job = pool.job;
+    pthread_mutex_unlock(&pool.lock);
+
+    parallel_worker(job);
+
+    pthread_mutex_lock(&pool.lock);
+    if(!--pool.running) pthread_cond_signal(&pool.done);
+  }
+  return NULL;
+}
+
+// Must be called with pool.lock held. If we can't get as many threads as we
+// asked for the calling thread just picks up the slack.
+static void grow_pool(size_t threads){
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+  while(pool.threads < threads){
+    pthread_t helper;
+    if(pthread_create(&helper, &attributes, pool_helper, NULL)) break;
+    pool.threads++;
+  }
+  pthread_attr_destroy(&attributes);
+}
+
+void parallel_for(size_t tasks, parallel_body body, void *context){
+  size_t threads = parallel_thread_count();
+  if(threads > tasks) threads = tasks;
+  if(_inside_parallel_for) threads = 1;
+
+  parallel_job job = { tasks, 0, body, context };
+
+  if(threads <= 1 || pthread_mutex_trylock(&pool_owner)){
+    parallel_worker(&job);
+    return;
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  grow_pool(threads - 1);
+  pool.wanted = threads - 1 < pool.threads ? threads - 1 : pool.threads;
+  pool.job = &job;
+  pool.generation++;
+  pthread_cond_broadcast(&pool.wake);
+  pthread_mutex_unlock(&pool.lock);
+
+  parallel_worker(&job);
+
+  pthread_mutex_lock(&pool.lock);
+  pool.wanted = 0;
+  while(pool.running) pthread_cond_wait(&pool.done, &pool.lock);
+  pool.job = NULL;
+  pthread_mutex_unlock(&pool.lock);
+
+  pthread_mutex_unlock(&pool_owner);
+}
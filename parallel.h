@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdlib.h>
+
+// Minimal fork/join helper shared by the multithreaded passes, backed by a
+// pool of helper threads that persists between calls.
+// Tasks are handed out dynamically, so a body must only rely on its task
+// index and never on which thread happens to run it.
+
+typedef void (*parallel_body)(void *context, size_t task);
+
+size_t parallel_thread_count();
+void set_parallel_thread_count(size_t n);
+
+void parallel_for(size_t tasks, parallel_body body, void *context);
+#endif
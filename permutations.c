@@ -68,6 +68,34 @@ size_t random_number(size_t n){
 	}
 }
 
+void random_seed(random_state *r, uint64_t seed){
+	r->state = seed;
+}
+
+// splitmix64
+static uint64_t random_next(random_state *r){
+	uint64_t z = (r->state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+size_t random_number_r(random_state *r, size_t n){
+	size_t mask = saturate(n);
+
+	size_t result;
+
+	for(;;){
+		result = random_next(r) & mask;
+		if(result < n) return result;
+	}
+}
+
+// Uniform in [0, 1)
+double random_double_r(random_state *r){
+	return (random_next(r) >> 11) * (1.0 / 9007199254740992.0);
+}
+
 void shuffle(size_t length, size_t *data){
 	for(size_t k = length - 1; k > 0; k--){
 		size_t j = random_number(k+1);
@@ -1,7 +1,21 @@
+#ifndef PERMUTATIONS_H
+#define PERMUTATIONS_H
+
 #include <stdlib.h>
+#include <stdint.h>
+
+// Explicit generator state, so that threads don't fight over rand() and
+// so the state of a run can be saved and restored.
+typedef struct {
+  uint64_t state;
+} random_state;
 
 size_t next_permutation(size_t length, size_t *data);
 void shuffle(size_t length, size_t *data);
 void reverse(size_t *s, size_t *e);
 size_t random_number(size_t n);
+void random_seed(random_state *r, uint64_t seed);
+size_t random_number_r(random_state *r, size_t n);
+double random_double_r(random_state *r);
 void generate_shuffled_range(size_t length, size_t *data);
+#endif
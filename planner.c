@@ -0,0 +1,137 @@
+#include "planner.h"
+#include <stddef.h>
+#include <string.h>
+
+#define PLAN_EXACT 15
+#define PLAN_POPULATION 500
+#define PLAN_GENERATIONS 1000
+#define PLAN_WINDOW 10
+// Large tournaments where almost every pair is tied get a smaller
+// population: each generation costs O(n^2) to score, and on these the
+// population does little that smoothing doesn't
+#define PLAN_MAX_TIES 0.9
+#define PLAN_SMALL 200
+#define PLAN_SPARSE_POPULATION 100
+#define PLAN_SPARSE_GENERATIONS 200
+
+typedef struct {
+  const char *name;
+  size_t offset;
+} plan_field;
+
+static const plan_field plan_fields[] = {
+  { "exact", offsetof(fas_plan, exact) },
+  { "split", offsetof(fas_plan, split) },
+  { "population", offsetof(fas_plan, population) },
+  { "generations", offsetof(fas_plan, generations) },
+  { "smoothing", offsetof(fas_plan, smoothing) },
+  { "window", offsetof(fas_plan, window) },
+};
+
+#define PLAN_FIELD_COUNT (sizeof(plan_fields) / sizeof(plan_field))
+
+static size_t _override_values[PLAN_FIELD_COUNT];
+static int _override_set[PLAN_FIELD_COUNT];
+
+static size_t *plan_field_ref(fas_plan *plan, size_t k){
+  return (size_t*)((char*)plan + plan_fields[k].offset);
+}
+
+int set_plan_overrides(const char *spec){
+  size_t values[PLAN_FIELD_COUNT];
+  int set[PLAN_FIELD_COUNT];
+  memset(values, 0, sizeof(values));
+  memset(set, 0, sizeof(set));
+
+  while(spec && *spec){
+    const char *equals = strchr(spec, '=');
+    if(!equals) return 0;
+    size_t length = equals - spec;
+
+    size_t k = 0;
+    while(k < PLAN_FIELD_COUNT &&
+          (strlen(plan_fields[k].name) != length || strncmp(plan_fields[k].name, spec, length))){
+      k++;
+    }
+    if(k == PLAN_FIELD_COUNT) return 0;
+
+    char *end;
+    values[k] = strtoul(equals + 1, &end, 10);
+    if(end == equals + 1 || (*end && *end != ',')) return 0;
+    set[k] = 1;
+    spec = *end ? end + 1 : end;
+  }
+
+  for(size_t k = 0; k < PLAN_FIELD_COUNT; k++){
+    _override_set[k] = set[k];
+    _override_values[k] = values[k];
+  }
+  return 1;
+}
+
+static void measure_ties(fas_optimiser *o, size_t n, size_t *items, fas_plan *plan){
+  size_t pairs = n * (n - 1) / 2;
+  size_t tied = 0;
+
+  for(size_t i = 0; i < n; i++){
+    for(size_t j = i + 1; j < n; j++){
+      if(!margin_compare(o, items[i], items[j])) tied++;
+    }
+  }
+
+  plan->ties = pairs ? (double)tied / pairs : 0.0;
+}
+
+fas_plan plan_ordering(fas_optimiser *o, size_t n, size_t *items, int given){
+  fas_plan plan;
+  memset(&plan, 0, sizeof(plan));
+  plan.size = n;
+  plan.components = 1;
+  measure_ties(o, n, items, &plan);
+
+  size_t *seed = NULL;
+  if(n > PLAN_EXACT){
+    seed = malloc(n * sizeof(size_t));
+    memcpy(seed, items, n * sizeof(size_t));
+    // Without a starting point from the caller we make one. Either way it
+    // is locally sorted: kwik_sort leaves the partitions at its depth limit
+    // unsorted, and any ordering that isn't locally sorted may interleave
+    // components and hide the cuts between them
+    if(!given) kwik_sort(o, n, seed, 0);
+    local_sort(o, n, seed);
+
+    unsigned char *clean = condorcet_cuts(o, n, seed);
+    for(size_t p = 0; p + 1 < n; p++) plan.components += clean[p];
+    free(clean);
+  }
+
+  plan.exact = PLAN_EXACT;
+  plan.split = plan.components > 1;
+  if(n <= PLAN_SMALL || plan.ties <= PLAN_MAX_TIES){
+    plan.population = PLAN_POPULATION;
+    plan.generations = PLAN_GENERATIONS;
+  } else {
+    plan.population = PLAN_SPARSE_POPULATION;
+    plan.generations = PLAN_SPARSE_GENERATIONS;
+  }
+  plan.smoothing = 1;
+  plan.window = PLAN_WINDOW;
+
+  for(size_t k = 0; k < PLAN_FIELD_COUNT; k++){
+    if(_override_set[k]) *plan_field_ref(&plan, k) = _override_values[k];
+  }
+
+  if(seed && plan.split) memcpy(items, seed, n * sizeof(size_t));
+  free(seed);
+  return plan;
+}
+
+void print_plan(FILE *f, fas_plan *plan){
+  fprintf(f, "Plan for %lu items: ties %.3f, %lu components\n",
+          (unsigned long)plan->size, plan->ties, (unsigned long)plan->components);
+  for(size_t k = 0; k < PLAN_FIELD_COUNT; k++){
+    fprintf(f, "%s%s=%lu%s", k ? "," : "  ", plan_fields[k].name,
+            (unsigned long)*plan_field_ref(plan, k), _override_set[k] ? " (overridden)" : "");
+  }
+  fprintf(f, "\n");
+}
@@ -0,0 +1,49 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include "fas_optimiser.h"
+
+// Chooses which phases of the optimal_ordering pipeline to run, and with
+// what parameters, from a few cheap statistics of the tournament.
+//
+// The statistics are the fraction of pairs that are tied to within
+// ACCURACY (which includes the pairs with no weight) and the number of
+// condorcet components of a locally sorted seed ordering. Components can
+// be optimised independently and concatenated without losing anything.
+// How many pairs have any weight at all isn't measured: every choice that
+// it could inform is already made as well by the fraction tied.
+//
+// Any choice can be overridden with set_plan_overrides, which takes a comma
+// separated list of key=value pairs, e.g. "population=200,window=12".
+// The keys are the names of the choice fields below.
+typedef struct {
+  size_t size;
+  double ties;
+  size_t components;
+
+  // Tournaments (and components) of at most this many items are solved
+  // exactly by table_optimise
+  size_t exact;
+  // Whether to optimise condorcet components separately
+  size_t split;
+  // A population of 0 skips the population phase
+  size_t population;
+  size_t generations;
+  size_t smoothing;
+  // A window of 0 skips the window phase
+  size_t window;
+} fas_plan;
+
+// Returns 0 if spec couldn't be parsed, in which case nothing is changed.
+// NULL clears any overrides.
+int set_plan_overrides(const char *spec);
+
+// Measures n items of o and plans how to optimise them. If given, items is
+// a starting ordering chosen by the caller and the seed is that ordering
+// locally sorted; otherwise the seed is kwik sorted first. If the plan is
+// to split into components, items is left in the seed ordering the
+// components were found in, which is never worse than a given one.
+fas_plan plan_ordering(fas_optimiser *o, size_t n, size_t *items, int given);
+
+void print_plan(FILE *f, fas_plan *plan);
+#endif
@@ -7,11 +7,13 @@ population *population_new(size_t population_count, size_t members_size){
   memset(p, '\0', size);
   p->members_size = members_size;
   p->population_count = population_count;
+  p->pool = malloc(population_count * members_size * sizeof(size_t));
+  for(size_t i = 0; i < population_count; i++) p->members[i].data = p->pool + i * members_size;
   return p;
 }
 
 void population_del(population *p){
-  for(size_t i = 0; i < p->population_count; i++) free(p->members[i].data);
+  free(p->pool);
   free(p);
 }
 
@@ -52,7 +54,7 @@ void population_heapify(population *p){
 int population_contains_under(population *p, double key, size_t *data, size_t i){
   if(i >= p->population_count) return 0;
   if(key < p->members[i].score) return 0;
-  if(memcmp(data, p->members[i].data, p->members_size * sizeof(size_t))) return 1;
+  if(key == p->members[i].score && !memcmp(data, p->members[i].data, p->members_size * sizeof(size_t))) return 1;
   return population_contains_under(p, key, data, 2*i + 1) || population_contains_under(p, key, data, 2*i + 2);
 } 
 
@@ -72,7 +74,10 @@ population_member fittest_member(population *p){
   return *best_member;
 }
 
+// Only a key that beats the current weakest member displaces it, so a
+// push can never make the population worse
 void population_push(population *p, double key, size_t *data){
+  if(key <= p->members[0].score) return;
   p->members[0].score = key;
   memcpy(p->members[0].data, data, p->members_size* sizeof(size_t));
   bubble_down(p, 0);
@@ -1,3 +1,6 @@
+#ifndef POPULATION_H
+#define POPULATION_H
+
 #include <stdlib.h>
 
 typedef struct {
@@ -5,9 +8,11 @@ typedef struct {
   size_t *data;
 } population_member;
 
+// Member data all comes from one pool, allocated along with the population
 typedef struct {
   size_t members_size;
   size_t population_count;
+  size_t *pool;
   population_member members[1];
 } population;
 
@@ -19,3 +24,4 @@ int population_contains(population *p, double key, size_t *data);
 
 population_member fittest_member(population *p);
 void population_push(population *p, double key, size_t *data);
+#endif
@@ -0,0 +1,306 @@
+#define _POSIX_C_SOURCE 200809L
+#include "fas_optimiser.h"
+#include "parallel.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+// Multi-start portfolio search under a wall clock budget.
+//
+// One worker per thread, each running short units of work with a different
+// strategy per unit, all sharing a single incumbent. Whenever a worker
+// finishes a unit with something better than the incumbent it publishes it.
+// Workers that have fallen too far behind, or that haven't improved their
+// own ordering for a while, restart from the incumbent. Each worker's
+// optimiser carries the deadline, so the population, window and single
+// move passes inside a unit stop early once it has passed, as does
+// annealing every ANNEAL_CHECK_STEPS steps. A unit that is cut short still
+// leaves a consistent ordering to offer, so the budget is overshot by
+// about one generation or scoring of the ordering rather than by whole
+// units. Workers share one table_optimise memo, since after restarting
+// from the incumbent they tend to optimise the same windows.
+
+#define PORTFOLIO_LAG 0.002
+#define PORTFOLIO_PATIENCE 3
+#define PORTFOLIO_POPULATION 50
+#define PORTFOLIO_GENERATIONS 200
+#define PORTFOLIO_NOISE 0.1
+#define PORTFOLIO_SAMPLES 32
+#define PORTFOLIO_MEMO_CAP ((size_t)256 << 20)
+#define ANNEAL_STEPS_PER_ITEM 200
+#define ANNEAL_RADIUS 32
+#define ANNEAL_START_TEMPERATURE 0.5
+#define ANNEAL_CHECK_STEPS 1024
+
+typedef enum {
+  STRATEGY_POPULATION,
+  STRATEGY_BORDA,
+  STRATEGY_CONDORCET,
+  STRATEGY_ANNEALING,
+  STRATEGY_WINDOW,
+  STRATEGY_COUNT
+} portfolio_strategy;
+
+static const char *strategy_names[STRATEGY_COUNT] = {
+  "population", "borda", "condorcet", "annealing", "window"
+};
+
+static const size_t window_sizes[] = { 6, 8, 10 };
+
+typedef struct {
+  pthread_mutex_t lock;
+  // Written under the lock, but read without it to decide whether an
+  // offer is worth taking the lock for
+  double score;
+  size_t *ordering;
+} incumbent;
+
+typedef struct {
+  fas_optimiser *parent;
+  size_t n;
+  double deadline;
+  double *borda;
+  uint64_t *seeds;
+  incumbent best;
+  size_t wins[STRATEGY_COUNT];
+} portfolio;
+
+typedef struct {
+  size_t index;
+  double key;
+} keyed_item;
+
+static double monotonic_seconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double incumbent_score(incumbent *b){
+  double score;
+  __atomic_load(&b->score, &score, __ATOMIC_ACQUIRE);
+  return score;
+}
+
+static int incumbent_offer(incumbent *b, size_t n, size_t *items, double score){
+  if(score <= incumbent_score(b)) return 0;
+
+  int accepted = 0;
+  pthread_mutex_lock(&b->lock);
+  if(score > b->score){
+    memcpy(b->ordering, items, n * sizeof(size_t));
+    __atomic_store(&b->score, &score, __ATOMIC_RELEASE);
+    accepted = 1;
+  }
+  pthread_mutex_unlock(&b->lock);
+  return accepted;
+}
+
+static double incumbent_copy(incumbent *b, size_t n, size_t *items){
+  pthread_mutex_lock(&b->lock);
+  memcpy(items, b->ordering, n * sizeof(size_t));
+  double score = b->score;
+  pthread_mutex_unlock(&b->lock);
+  return score;
+}
+
+static int compare_keyed_items(const void *xx, const void *yy){
+  const keyed_item *x = xx;
+  const keyed_item *y = yy;
+
+  if(x->key > y->key) return -1;
+  if(x->key < y->key) return 1;
+  return 0;
+}
+
+static void sort_by_keys(size_t n, size_t *items, keyed_item *keys){
+  qsort(keys, n, sizeof(keyed_item), compare_keyed_items);
+  for(size_t i = 0; i < n; i++) items[i] = keys[i].index;
+}
+
+// Borda ranking with each count jittered a little, so repeated units don't
+// all start from the same place
+static void noisy_borda(fas_optimiser *o, portfolio *pf, size_t *items){
+  size_t n = pf->n;
+  keyed_item *keys = malloc(n * sizeof(keyed_item));
+  for(size_t i = 0; i < n; i++){
+    keys[i].index = i;
+    keys[i].key = pf->borda[i] * (1 + PORTFOLIO_NOISE * (random_double_r(&o->rng) - 0.5));
+  }
+  sort_by_keys(n, items, keys);
+  free(keys);
+}
+
+// Copeland ranking estimated from a random sample of opponents per item
+static void sampled_condorcet(fas_optimiser *o, size_t n, size_t *items){
+  keyed_item *keys = malloc(n * sizeof(keyed_item));
+  for(size_t i = 0; i < n; i++){
+    double wins = 0;
+    for(size_t s = 0; s < PORTFOLIO_SAMPLES; s++){
+      size_t j = random_number_r(&o->rng, n);
+      if(j != i) wins -= margin_compare(o, i, j);
+    }
+    keys[i].index = i;
+    // The fractional part breaks ties randomly
+    keys[i].key = wins + random_double_r(&o->rng);
+  }
+  sort_by_keys(n, items, keys);
+  free(keys);
+}
+
+// Simulated annealing over single moves of bounded distance, with deltas
+// read straight off the margin matrix and a linear cooling schedule
+static void anneal(fas_optimiser *o, size_t n, size_t *items){
+  margin_matrix *m = o->margins;
+
+  double scale = 0;
+  for(size_t s = 0; s < PORTFOLIO_SAMPLES; s++){
+    size_t i = random_number_r(&o->rng, n);
+    size_t j = random_number_r(&o->rng, n);
+    scale += fabs(margin_matrix_get(m, i, j));
+  }
+  scale /= PORTFOLIO_SAMPLES;
+  if(scale == 0) return;
+
+  size_t steps = ANNEAL_STEPS_PER_ITEM * n;
+  for(size_t s = 0; s < steps; s++){
+    if(s % ANNEAL_CHECK_STEPS == 0 && optimiser_stopping(o)) break;
+    double temperature = scale * ANNEAL_START_TEMPERATURE * (1 - (double)s / steps);
+    size_t index = random_number_r(&o->rng, n);
+    size_t offset = 1 + random_number_r(&o->rng, ANNEAL_RADIUS);
+    size_t x = items[index];
+    double delta = 0;
+
+    if(random_number_r(&o->rng, 2)){
+      if(offset > index) offset = index;
+      if(!offset) continue;
+      for(size_t k = index - offset; k < index; k++) delta += margin_matrix_get(m, x, items[k]);
+      if(delta < 0 && random_double_r(&o->rng) >= exp(delta / temperature)) continue;
+      memmove(items + index - offset + 1, items + index - offset, offset * sizeof(size_t));
+      items[index - offset] = x;
+    } else {
+      if(index + offset >= n) offset = n - 1 - index;
+      if(!offset) continue;
+      for(size_t k = index + 1; k <= index + offset; k++) delta += margin_matrix_get(m, items[k], x);
+      if(delta < 0 && random_double_r(&o->rng) >= exp(delta / temperature)) continue;
+      memmove(items + index, items + index + 1, offset * sizeof(size_t));
+      items[index + offset] = x;
+    }
+  }
+}
+
+static void run_unit(fas_optimiser *o, portfolio *pf, portfolio_strategy strategy, size_t round, size_t *items){
+  size_t n = pf->n;
+
+  switch(strategy){
+    case STRATEGY_POPULATION:
+      population_optimise(o, n, items, PORTFOLIO_POPULATION, PORTFOLIO_GENERATIONS);
+      break;
+    case STRATEGY_BORDA:
+      noisy_borda(o, pf, items);
+      break;
+    case STRATEGY_CONDORCET:
+      sampled_condorcet(o, n, items);
+      break;
+    case STRATEGY_ANNEALING:
+      anneal(o, n, items);
+      break;
+    case STRATEGY_WINDOW:
+      window_optimise(o, n, items, window_sizes[round % (sizeof(window_sizes) / sizeof(size_t))]);
+      break;
+    case STRATEGY_COUNT:
+      break;
+  }
+
+  single_move_optimise(o, n, items);
+  reset_optimiser(o);
+}
+
+static void portfolio_worker(void *context, size_t worker){
+  portfolio *pf = context;
+  size_t n = pf->n;
+
+  if(monotonic_seconds() >= pf->deadline) return;
+
+  fas_optimiser *o = new_optimiser_sharing(pf->parent, pf->seeds[worker]);
+  o->deadline = pf->deadline;
+  size_t *items = malloc(n * sizeof(size_t));
+  double own_best = incumbent_copy(&pf->best, n, items);
+  size_t stale = 0;
+
+  for(size_t round = 0; monotonic_seconds() < pf->deadline; round++){
+    portfolio_strategy strategy = (worker + round) % STRATEGY_COUNT;
+    run_unit(o, pf, strategy, round, items);
+
+    double score = score_fas_tournament(o->tournament, n, items);
+    if(incumbent_offer(&pf->best, n, items, score)){
+      __sync_fetch_and_add(pf->wins + strategy, 1);
+      FASDEBUG("Portfolio worker %lu improved to %f with %s\n",
+               (unsigned long)worker, score, strategy_names[strategy]);
+    }
+
+    if(score > own_best){
+      own_best = score;
+      stale = 0;
+    } else {
+      stale++;
+    }
+
+    double best = incumbent_score(&pf->best);
+    if(best - score > PORTFOLIO_LAG * best || stale >= PORTFOLIO_PATIENCE){
+      own_best = incumbent_copy(&pf->best, n, items);
+      stale = 0;
+    }
+  }
+
+  free(items);
+  del_optimiser(o);
+}
+
+size_t *portfolio_ordering(tournament *t, size_t *results, double seconds){
+  size_t n = t->size;
+  if(results == NULL){
+    results = integer_range(n);
+  }
+
+  if(n <= 15) return optimal_ordering(t, results);
+
+  portfolio pf;
+  pf.parent = new_optimiser(t);
+  pf.parent->shared_table = shared_optimisation_table_new(PORTFOLIO_MEMO_CAP);
+  pf.n = n;
+  pf.deadline = monotonic_seconds() + seconds;
+  memset(pf.wins, 0, sizeof(pf.wins));
+
+  pf.borda = malloc(n * sizeof(double));
+  for(size_t i = 0; i < n; i++){
+    double total = 0;
+    for(size_t j = 0; j < n; j++) total += margin_matrix_get(pf.parent->margins, i, j);
+    pf.borda[i] = total;
+  }
+
+  size_t workers = parallel_thread_count();
+  pf.seeds = malloc(workers * sizeof(uint64_t));
+  for(size_t w = 0; w < workers; w++) pf.seeds[w] = random_number_r(&pf.parent->rng, SIZE_MAX);
+
+  pthread_mutex_init(&pf.best.lock, NULL);
+  pf.best.ordering = results;
+  pf.best.score = score_fas_tournament(t, n, results);
+
+  FASDEBUG("Portfolio of %lu workers for %f seconds\n", (unsigned long)workers, seconds);
+  parallel_for(workers, portfolio_worker, &pf);
+
+  for(size_t s = 0; s < STRATEGY_COUNT; s++){
+    FASDEBUG("Portfolio %s: %lu improvements\n", strategy_names[s], (unsigned long)pf.wins[s]);
+  }
+
+  FASDEBUG("Portfolio memo: %lu bytes\n", (unsigned long)shared_optimisation_table_bytes(pf.parent->shared_table));
+
+  shared_optimisation_table_del(pf.parent->shared_table);
+  pthread_mutex_destroy(&pf.best.lock);
+  free(pf.seeds);
+  free(pf.borda);
+  del_optimiser(pf.parent);
+  return results;
+}
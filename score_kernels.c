@@ -0,0 +1,338 @@
+#include "fas_tournament.h"
+#include "parallel.h"
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+// score_fas_tournament sums W[data[i]][data[j]] over i < j, which for each
+// row data[i] is a gather of the entries for everything after it.
+//
+// When the ordering covers most of the tournament it's cheaper to sweep
+// the whole row contiguously and mask out the columns that aren't after
+// position i, so rows are scored one of two ways:
+//
+// * gather: sum row[data[j]] for j > i
+// * masked: sum row[c] for every column c with position[c] > i
+//
+// Gathers have a scalar version and AVX2 / AVX-512 versions picked at
+// runtime. The masked form only pays off with vector compares, so without
+// them every row is gathered.
+// Large orderings are split into a fixed number of chunks of rows which
+// are summed in order, so the result doesn't depend on the thread count.
+
+#define SCORE_PARALLEL_THRESHOLD 1024
+#define SCORE_CHUNKS 64
+#define SCORE_GATHER_MIN 16
+
+typedef double (*gather_kernel)(const void *row, const size_t *data, size_t count);
+typedef double (*masked_kernel)(const void *row, const uint32_t *positions, size_t n, uint32_t after);
+
+static double gather_double_scalar(const void *r, const size_t *data, size_t count){
+  const double *row = r;
+  double sum = 0.0;
+  for(size_t j = 0; j < count; j++) sum += row[data[j]];
+  return sum;
+}
+
+static double gather_float_scalar(const void *r, const size_t *data, size_t count){
+  const float *row = r;
+  double sum = 0.0;
+  for(size_t j = 0; j < count; j++) sum += row[data[j]];
+  return sum;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("avx2")))
+static double horizontal_sum_avx2(__m256d x){
+  double lanes[4];
+  _mm256_storeu_pd(lanes, x);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+__attribute__((target("avx2")))
+static double gather_double_avx2(const void *r, const size_t *data, size_t count){
+  const double *row = r;
+  __m256d acc = _mm256_setzero_pd();
+  size_t j = 0;
+  for(; j + 4 <= count; j += 4){
+    __m256i indices = _mm256_loadu_si256((const __m256i*)(data + j));
+    acc = _mm256_add_pd(acc, _mm256_i64gather_pd(row, indices, 8));
+  }
+  double sum = horizontal_sum_avx2(acc);
+  for(; j < count; j++) sum += row[data[j]];
+  return sum;
+}
+
+__attribute__((target("avx2")))
+static double gather_float_avx2(const void *r, const size_t *data, size_t count){
+  const float *row = r;
+  __m256d acc = _mm256_setzero_pd();
+  size_t j = 0;
+  for(; j + 4 <= count; j += 4){
+    __m256i indices = _mm256_loadu_si256((const __m256i*)(data + j));
+    acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_i64gather_ps(row, indices, 4)));
+  }
+  double sum = horizontal_sum_avx2(acc);
+  for(; j < count; j++) sum += row[data[j]];
+  return sum;
+}
+
+__attribute__((target("avx2")))
+static double masked_double_avx2(const void *r, const uint32_t *positions, size_t n, uint32_t after){
+  const double *row = r;
+  // Positions are below 2^31 so a signed comparison is fine
+  __m128i threshold = _mm_set1_epi32((int)after);
+  __m256d acc = _mm256_setzero_pd();
+  size_t c = 0;
+  for(; c + 4 <= n; c += 4){
+    __m128i p = _mm_loadu_si128((const __m128i*)(positions + c));
+    __m256i mask = _mm256_cvtepi32_epi64(_mm_cmpgt_epi32(p, threshold));
+    acc = _mm256_add_pd(acc, _mm256_and_pd(_mm256_loadu_pd(row + c), _mm256_castsi256_pd(mask)));
+  }
+  double sum = horizontal_sum_avx2(acc);
+  for(; c < n; c++) sum += positions[c] > after ? row[c] : 0.0;
+  return sum;
+}
+
+__attribute__((target("avx2")))
+static double masked_float_avx2(const void *r, const uint32_t *positions, size_t n, uint32_t after){
+  const float *row = r;
+  __m128i threshold = _mm_set1_epi32((int)after);
+  __m256d acc = _mm256_setzero_pd();
+  size_t c = 0;
+  for(; c + 4 <= n; c += 4){
+    __m128i p = _mm_loadu_si128((const __m128i*)(positions + c));
+    __m128 values = _mm_and_ps(_mm_loadu_ps(row + c), _mm_castsi128_ps(_mm_cmpgt_epi32(p, threshold)));
+    acc = _mm256_add_pd(acc, _mm256_cvtps_pd(values));
+  }
+  double sum = horizontal_sum_avx2(acc);
+  for(; c < n; c++) sum += positions[c] > after ? row[c] : 0.0;
+  return sum;
+}
+
+__attribute__((target("avx512f")))
+static double gather_double_avx512(const void *r, const size_t *data, size_t count){
+  const double *row = r;
+  __m512d acc = _mm512_setzero_pd();
+  size_t j = 0;
+  for(; j + 8 <= count; j += 8){
+    __m512i indices = _mm512_loadu_si512((const void*)(data + j));
+    acc = _mm512_add_pd(acc, _mm512_i64gather_pd(indices, row, 8));
+  }
+  double sum = _mm512_reduce_add_pd(acc);
+  for(; j < count; j++) sum += row[data[j]];
+  return sum;
+}
+
+__attribute__((target("avx512f")))
+static double gather_float_avx512(const void *r, const size_t *data, size_t count){
+  const float *row = r;
+  __m512d acc = _mm512_setzero_pd();
+  size_t j = 0;
+  for(; j + 8 <= count; j += 8){
+    __m512i indices = _mm512_loadu_si512((const void*)(data + j));
+    acc = _mm512_add_pd(acc, _mm512_cvtps_pd(_mm512_i64gather_ps(indices, row, 4)));
+  }
+  double sum = _mm512_reduce_add_pd(acc);
+  for(; j < count; j++) sum += row[data[j]];
+  return sum;
+}
+
+__attribute__((target("avx512f")))
+static double masked_double_avx512(const void *r, const uint32_t *positions, size_t n, uint32_t after){
+  const double *row = r;
+  __m512i threshold = _mm512_set1_epi32((int)after);
+  __m512d acc = _mm512_setzero_pd();
+  size_t c = 0;
+  for(; c + 16 <= n; c += 16){
+    __mmask16 mask = _mm512_cmpgt_epu32_mask(_mm512_loadu_si512((const void*)(positions + c)), threshold);
+    acc = _mm512_mask_add_pd(acc, (__mmask8)mask, acc, _mm512_loadu_pd(row + c));
+    acc = _mm512_mask_add_pd(acc, (__mmask8)(mask >> 8), acc, _mm512_loadu_pd(row + c + 8));
+  }
+  double sum = _mm512_reduce_add_pd(acc);
+  for(; c < n; c++) sum += positions[c] > after ? row[c] : 0.0;
+  return sum;
+}
+
+__attribute__((target("avx512f")))
+static double masked_float_avx512(const void *r, const uint32_t *positions, size_t n, uint32_t after){
+  const float *row = r;
+  __m512i threshold = _mm512_set1_epi32((int)after);
+  __m512d acc = _mm512_setzero_pd();
+  size_t c = 0;
+  for(; c + 16 <= n; c += 16){
+    __mmask16 mask = _mm512_cmpgt_epu32_mask(_mm512_loadu_si512((const void*)(positions + c)), threshold);
+    __m512 values = _mm512_maskz_loadu_ps(mask, row + c);
+    acc = _mm512_add_pd(acc, _mm512_cvtps_pd(_mm512_castps512_ps256(values)));
+    acc = _mm512_add_pd(acc, _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(values), 1))));
+  }
+  double sum = _mm512_reduce_add_pd(acc);
+  for(; c < n; c++) sum += positions[c] > after ? row[c] : 0.0;
+  return sum;
+}
+
+#endif
+
+typedef struct {
+  gather_kernel gather[2];
+  masked_kernel masked[2];
+  const char *name;
+} score_kernel_set;
+
+static score_kernel_set kernels;
+static pthread_once_t kernels_chosen = PTHREAD_ONCE_INIT;
+
+// FAS_SIMD=scalar|avx2|avx512 caps the instruction set, mostly so the
+// kernels can be benchmarked against each other.
+static void select_kernels(const char *cap){
+  kernels.gather[0] = gather_double_scalar;
+  kernels.gather[1] = gather_float_scalar;
+  kernels.masked[0] = NULL;
+  kernels.masked[1] = NULL;
+  kernels.name = "scalar";
+
+#ifdef HAVE_X86_KERNELS
+  if(cap && !strcmp(cap, "scalar")) return;
+
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")){
+    kernels.gather[0] = gather_double_avx2;
+    kernels.gather[1] = gather_float_avx2;
+    kernels.masked[0] = masked_double_avx2;
+    kernels.masked[1] = masked_float_avx2;
+    kernels.name = "avx2";
+  }
+
+  if(cap && !strcmp(cap, "avx2")) return;
+
+  if(__builtin_cpu_supports("avx512f")){
+    kernels.gather[0] = gather_double_avx512;
+    kernels.gather[1] = gather_float_avx512;
+    kernels.masked[0] = masked_double_avx512;
+    kernels.masked[1] = masked_float_avx512;
+    kernels.name = "avx512";
+  }
+#else
+  (void)cap;
+#endif
+}
+
+static void choose_kernels(){
+  select_kernels(getenv("FAS_SIMD"));
+}
+
+void set_score_kernel_cap(const char *cap){
+  pthread_once(&kernels_chosen, choose_kernels);
+  select_kernels(cap);
+}
+
+const char *score_kernel_name(){
+  pthread_once(&kernels_chosen, choose_kernels);
+  return kernels.name;
+}
+
+typedef struct {
+  tournament *t;
+  size_t count;
+  size_t *data;
+  uint32_t *positions;
+  size_t chunk_starts[SCORE_CHUNKS + 1];
+  double partials[SCORE_CHUNKS];
+} score_job;
+
+static double score_rows(score_job *job, size_t start, size_t end){
+  tournament *t = job->t;
+  size_t n = t->size;
+  size_t count = job->count;
+  size_t *data = job->data;
+  double score = 0.0;
+
+  if(t->precision == TOURNAMENT_FIXED16){
+    // Exact integer sums, scaled once by the caller
+    uint64_t total = 0;
+    for(size_t i = start; i < end; i++){
+      const uint16_t *row = t->entries.q + data[i] * n;
+      for(size_t j = i + 1; j < count; j++) total += row[data[j]];
+    }
+    return (double)total;
+  }
+
+  int k = t->precision == TOURNAMENT_FLOAT;
+  size_t entry_size = k ? sizeof(float) : sizeof(double);
+  const char *base = (const char*)t->entries.d;
+
+  for(size_t i = start; i < end; i++){
+    const void *row = base + data[i] * n * entry_size;
+    if(job->positions){
+      score += kernels.masked[k](row, job->positions, n, (uint32_t)(i + 1));
+    } else if(count - i - 1 >= SCORE_GATHER_MIN){
+      score += kernels.gather[k](row, data + i + 1, count - i - 1);
+    } else if(k){
+      score += gather_float_scalar(row, data + i + 1, count - i - 1);
+    } else {
+      score += gather_double_scalar(row, data + i + 1, count - i - 1);
+    }
+  }
+  return score;
+}
+
+static void score_chunk(void *context, size_t chunk){
+  score_job *job = context;
+  job->partials[chunk] = score_rows(job, job->chunk_starts[chunk], job->chunk_starts[chunk + 1]);
+}
+
+double score_fas_tournament(tournament *t, size_t count, size_t *data){
+  pthread_once(&kernels_chosen, choose_kernels);
+
+  score_job job;
+  job.t = t;
+  job.count = count;
+  job.data = data;
+  job.positions = NULL;
+
+  if(count < SCORE_PARALLEL_THRESHOLD){
+    double score = score_rows(&job, 0, count);
+    return t->precision == TOURNAMENT_FIXED16 ? score * t->scale : score;
+  }
+
+  size_t n = t->size;
+
+  // A masked row costs n contiguous loads against count - i - 1 gathers,
+  // and a gather is several times more expensive than a contiguous load.
+  int masked = t->precision != TOURNAMENT_FIXED16 &&
+               kernels.masked[t->precision == TOURNAMENT_FLOAT] &&
+               count * 4 >= n && n < ((size_t)1 << 31);
+
+  if(masked){
+    // Positions are offset by one so that 0 means "not in this ordering"
+    job.positions = calloc(n, sizeof(uint32_t));
+    for(size_t i = 0; i < count; i++) job.positions[data[i]] = (uint32_t)(i + 1);
+    for(size_t c = 0; c <= SCORE_CHUNKS; c++) job.chunk_starts[c] = count * c / SCORE_CHUNKS;
+  } else {
+    // Split the triangle of pairs into chunks of roughly equal size
+    double pairs = (double)count * (count - 1) / 2;
+    double seen = 0.0;
+    size_t chunk = 1;
+    job.chunk_starts[0] = 0;
+    for(size_t i = 0; i < count && chunk < SCORE_CHUNKS; i++){
+      seen += count - i - 1;
+      while(chunk < SCORE_CHUNKS && seen >= pairs * chunk / SCORE_CHUNKS){
+        job.chunk_starts[chunk++] = i + 1;
+      }
+    }
+    while(chunk <= SCORE_CHUNKS) job.chunk_starts[chunk++] = count;
+  }
+
+  parallel_for(SCORE_CHUNKS, score_chunk, &job);
+
+  double score = 0.0;
+  for(size_t c = 0; c < SCORE_CHUNKS; c++) score += job.partials[c];
+
+  free(job.positions);
+  return t->precision == TOURNAMENT_FIXED16 ? score * t->scale : score;
+}
@@ -0,0 +1,57 @@
+#include "scratch_arena.h"
+#include <stdint.h>
+
+// Everything we put in here is size_t or double sized
+#define SCRATCH_ALIGNMENT sizeof(double)
+
+static scratch_block *scratch_block_new(scratch_block *previous, size_t capacity){
+  scratch_block *b = malloc(sizeof(scratch_block) + capacity);
+  b->previous = previous;
+  b->capacity = capacity;
+  b->used = 0;
+  return b;
+}
+
+scratch_arena *scratch_arena_new(size_t capacity){
+  scratch_arena *a = malloc(sizeof(scratch_arena));
+  a->top = scratch_block_new(NULL, capacity);
+  a->in_use = 0;
+  a->peak = 0;
+  return a;
+}
+
+void scratch_arena_del(scratch_arena *a){
+  while(a->top){
+    scratch_block *previous = a->top->previous;
+    free(a->top);
+    a->top = previous;
+  }
+  free(a);
+}
+
+void *scratch_alloc(scratch_arena *a, size_t bytes){
+  bytes = (bytes + SCRATCH_ALIGNMENT - 1) & ~(SCRATCH_ALIGNMENT - 1);
+
+  scratch_block *b = a->top;
+  if(b->used + bytes > b->capacity){
+    size_t capacity = 2 * b->capacity;
+    if(capacity < bytes) capacity = bytes;
+    b = a->top = scratch_block_new(b, capacity);
+  }
+
+  void *result = (char*)b->data + b->used;
+  b->used += bytes;
+  a->in_use += bytes;
+  if(a->in_use > a->peak) a->peak = a->in_use;
+  return result;
+}
+
+void scratch_release(scratch_arena *a, scratch_mark m){
+  while(a->top != m.block){
+    scratch_block *previous = a->top->previous;
+    free(a->top);
+    a->top = previous;
+  }
+  a->top->used = m.used;
+  a->in_use = m.in_use;
+}
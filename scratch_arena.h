@@ -0,0 +1,43 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <stdlib.h>
+
+// Stack style scratch memory for the optimiser's temporary arrays.
+//
+// Allocations are bump allocated from the top block and given back in bulk
+// by releasing to a mark taken earlier, so a recursive pass takes a mark on
+// entry and releases it on exit. If the top block runs out a bigger one is
+// pushed on top, so a badly sized arena is slower but never wrong.
+
+typedef struct scratch_block {
+  struct scratch_block *previous;
+  size_t capacity;
+  size_t used;
+  double data[];
+} scratch_block;
+
+typedef struct {
+  scratch_block *top;
+  size_t in_use;
+  size_t peak;
+} scratch_arena;
+
+typedef struct {
+  scratch_block *block;
+  size_t used;
+  size_t in_use;
+} scratch_mark;
+
+scratch_arena *scratch_arena_new(size_t capacity);
+void scratch_arena_del(scratch_arena *a);
+
+void *scratch_alloc(scratch_arena *a, size_t bytes);
+
+static inline scratch_mark scratch_save(scratch_arena *a){
+  scratch_mark m = { a->top, a->top->used, a->in_use };
+  return m;
+}
+
+void scratch_release(scratch_arena *a, scratch_mark m);
+#endif
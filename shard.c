@@ -0,0 +1,425 @@
+#define _GNU_SOURCE
+#include "shard.h"
+#include "fas_optimiser.h"
+#include "parallel.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define SHARD_SEAM_RADIUS 128
+#define SHARD_SEAM_WINDOW 10
+#define SHARD_MAX_NODES 256
+#define SHARD_ROUNDS 2
+
+typedef struct {
+  size_t start;
+  size_t length;
+  // Whether the seam before this shard is a condorcet boundary, in which
+  // case nothing across it can be improved and it needs no repair
+  int clean_start;
+  // Set while the worker is running or unreaped
+  pid_t pid;
+  FILE *from;
+} shard;
+
+typedef struct {
+  size_t index;
+  double key;
+} keyed_item;
+
+typedef struct {
+  size_t count;
+  cpu_set_t cpus[SHARD_MAX_NODES];
+  size_t cpu_counts[SHARD_MAX_NODES];
+} numa_layout;
+
+static void fail(char *msg){
+  fprintf(stderr, "%s\n", msg);
+  exit(1);
+}
+
+// Reads /sys/devices/system/node/node*/cpulist, e.g. "0-3,8-11"
+static void read_numa_layout(numa_layout *layout){
+  layout->count = 0;
+
+  for(size_t node = 0; node < SHARD_MAX_NODES; node++){
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%lu/cpulist", (unsigned long)node);
+    FILE *f = fopen(path, "r");
+    if(!f) break;
+
+    cpu_set_t *set = layout->cpus + layout->count;
+    CPU_ZERO(set);
+    size_t count = 0;
+    unsigned long lo, hi;
+    while(fscanf(f, "%lu", &lo) == 1){
+      hi = lo;
+      int c = fgetc(f);
+      if(c == '-'){
+        if(fscanf(f, "%lu", &hi) != 1) break;
+        c = fgetc(f);
+      }
+      for(unsigned long cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++){
+        CPU_SET(cpu, set);
+        count++;
+      }
+      if(c != ',') break;
+    }
+    fclose(f);
+
+    if(count) layout->cpu_counts[layout->count++] = count;
+  }
+}
+
+// The coordinator keeps no margin matrix, which would cost it half as much
+// memory again as the tournament, so comparisons read the tournament
+static int beats(tournament *t, size_t i, size_t j){
+  return tournament_get(t, i, j) - tournament_get(t, j, i) >= ACCURACY;
+}
+
+static int compare_keyed_items(const void *xx, const void *yy){
+  const keyed_item *x = xx;
+  const keyed_item *y = yy;
+
+  if(x->key > y->key) return -1;
+  if(x->key < y->key) return 1;
+  return 0;
+}
+
+// Items by their total margin over everything else, in one row major pass,
+// then moved left past everything that doesn't strictly beat them as
+// local_sort does, so that condorcet components come apart
+static size_t *seed_ordering(tournament *t){
+  size_t n = t->size;
+  keyed_item *keys = calloc(n ? n : 1, sizeof(keyed_item));
+  for(size_t i = 0; i < n; i++){
+    keys[i].index = i;
+    for(size_t j = 0; j < n; j++){
+      if(i == j) continue;
+      double x = tournament_get(t, i, j);
+      keys[i].key += x;
+      keys[j].key -= x;
+    }
+  }
+  qsort(keys, n, sizeof(keyed_item), compare_keyed_items);
+
+  size_t *items = malloc(sizeof(size_t) * (n ? n : 1));
+  for(size_t i = 0; i < n; i++){
+    size_t x = keys[i].index;
+    size_t j = i;
+    while(j > 0 && !beats(t, items[j - 1], x)){
+      items[j] = items[j - 1];
+      j--;
+    }
+    items[j] = x;
+  }
+
+  free(keys);
+  return items;
+}
+
+// condorcet_cuts, reading the tournament
+static unsigned char *seed_cuts(tournament *t, size_t n, size_t *items){
+  unsigned char *clean = calloc(n ? n : 1, 1);
+  size_t *reach = malloc(sizeof(size_t) * (n ? n : 1));
+
+  for(size_t j = 0; j < n; j++){
+    reach[j] = j;
+    for(size_t i = 0; i < j; i++){
+      if(beats(t, items[j], items[i])){
+        reach[j] = i;
+        break;
+      }
+    }
+  }
+
+  size_t min_reach = n;
+  for(size_t p = n; p-- > 0;){
+    clean[p] = min_reach > p;
+    if(reach[p] < min_reach) min_reach = reach[p];
+  }
+
+  free(reach);
+  return clean;
+}
+
+// Repairs the band of items around a seam with an optimiser over just that
+// band. Single moves let items the seed put on the wrong side of the seam
+// cross it, and window passes then tidy up.
+static void repair_seam(tournament *t, size_t n, size_t *items, size_t seam){
+  size_t start = seam > SHARD_SEAM_RADIUS ? seam - SHARD_SEAM_RADIUS : 0;
+  size_t end = seam + SHARD_SEAM_RADIUS < n ? seam + SHARD_SEAM_RADIUS : n;
+  size_t length = end - start;
+
+  tournament *band = new_tournament(length);
+  for(size_t i = 0; i < length; i++){
+    for(size_t j = 0; j < length; j++){
+      if(i != j) tournament_set(band, i, j, tournament_get(t, items[start + i], items[start + j]));
+    }
+  }
+
+  fas_optimiser *o = new_optimiser(band);
+  size_t *local = integer_range(length);
+  single_move_optimise(o, length, local);
+  window_optimise(o, length, local, SHARD_SEAM_WINDOW);
+
+  for(size_t i = 0; i < length; i++) o->buffer[i] = items[start + local[i]];
+  memcpy(items + start, o->buffer, length * sizeof(size_t));
+
+  free(local);
+  del_optimiser(o);
+  del_tournament(band);
+}
+
+// Shards are cut every target items, or at a condorcet boundary if there is
+// one within a quarter of target of that. offset shortens the first shard,
+// so that a second round can put its seams in different places.
+static shard *plan_shards(unsigned char *clean, size_t n, size_t target, size_t offset, size_t *count){
+  shard *shards = calloc(n, sizeof(shard));
+  size_t k = 0;
+  size_t start = 0;
+  size_t slack = target / 4;
+  size_t length = offset ? offset : target;
+
+  while(start < n){
+    size_t end = start + length;
+    size_t cut = n;
+
+    if(end + slack < n){
+      // A cut at c falls between items c - 1 and c, so is clean if clean[c - 1]
+      cut = end;
+      for(size_t d = 0; d <= slack; d++){
+        if(end + d < n && clean[end + d - 1]){
+          cut = end + d;
+          break;
+        }
+        if(end - d > start && clean[end - d - 1]){
+          cut = end - d;
+          break;
+        }
+      }
+    }
+
+    shards[k].start = start;
+    shards[k].length = cut - start;
+    shards[k].clean_start = start == 0 || clean[start - 1];
+    k++;
+    start = cut;
+    length = target;
+  }
+
+  *count = k;
+  return shards;
+}
+
+static void write_shard(tournament *t, size_t *items, shard *s, FILE *f){
+  write_tournament_binary_header(f, s->length);
+  for(size_t i = 0; i < s->length; i++){
+    for(size_t j = 0; j < s->length; j++){
+      if(i == j) continue;
+      double x = tournament_get(t, items[s->start + i], items[s->start + j]);
+      if(x != 0.0) write_tournament_binary_entry(f, i, j, x);
+    }
+  }
+}
+
+// Kills and reaps every worker of the round that is still around before
+// giving up, so that none are left running without us
+static void fail_round(shard *shards, size_t count, char *msg){
+  for(size_t k = 0; k < count; k++){
+    if(shards[k].pid > 0) kill(shards[k].pid, SIGKILL);
+  }
+  for(size_t k = 0; k < count; k++){
+    if(shards[k].pid > 0) waitpid(shards[k].pid, NULL, 0);
+    shards[k].pid = 0;
+  }
+  fail(msg);
+}
+
+// Returns an error message, or NULL if the worker got its shard
+static char *start_worker(tournament *t, size_t *items, shard *s, const char *worker_path,
+                          numa_layout *layout, size_t node, size_t threads){
+  int to_worker[2];
+  int from_worker[2];
+  if(pipe(to_worker)) return "Could not create pipes for shard worker";
+  if(pipe(from_worker)){
+    close(to_worker[0]);
+    close(to_worker[1]);
+    return "Could not create pipes for shard worker";
+  }
+  fcntl(to_worker[1], F_SETFD, FD_CLOEXEC);
+  fcntl(from_worker[0], F_SETFD, FD_CLOEXEC);
+
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if(pid < 0){
+    close(to_worker[0]);
+    close(to_worker[1]);
+    close(from_worker[0]);
+    close(from_worker[1]);
+    return "Could not fork shard worker";
+  }
+
+  if(pid == 0){
+    dup2(to_worker[0], 0);
+    dup2(from_worker[1], 1);
+    close(to_worker[0]);
+    close(from_worker[1]);
+
+    if(layout->count > 1) sched_setaffinity(0, sizeof(cpu_set_t), layout->cpus + node);
+    char thread_setting[32];
+    snprintf(thread_setting, sizeof(thread_setting), "%lu", (unsigned long)threads);
+    setenv("FAS_THREADS", thread_setting, 1);
+
+    execl(worker_path, worker_path, "--worker", "--precision",
+          tournament_precision_name(t->precision), (char*)NULL);
+    fprintf(stderr, "Could not run %s\n", worker_path);
+    _exit(127);
+  }
+
+  close(to_worker[0]);
+  close(from_worker[1]);
+
+  s->pid = pid;
+  s->from = fdopen(from_worker[0], "rb");
+
+  FILE *to = fdopen(to_worker[1], "wb");
+  write_shard(t, items, s, to);
+  if(fclose(to)) return "Could not send shard to worker";
+  return NULL;
+}
+
+// Returns an error message, or NULL if the worker's ordering was copied
+// into items. Either way the worker has been reaped if it could be.
+static char *collect_worker(shard *s, size_t *items){
+  char *error = NULL;
+  uint64_t count;
+  size_t *local = malloc(s->length * sizeof(size_t));
+  unsigned char *seen = calloc(s->length, 1);
+
+  if(fread(&count, sizeof(uint64_t), 1, s->from) != 1 || count != s->length){
+    error = "Shard worker returned a bad ordering";
+  }
+  for(size_t i = 0; !error && i < s->length; i++){
+    uint64_t x;
+    if(fread(&x, sizeof(uint64_t), 1, s->from) != 1 || x >= s->length || seen[x]){
+      error = "Shard worker returned a bad ordering";
+      break;
+    }
+    seen[x] = 1;
+    local[i] = items[s->start + x];
+  }
+  fclose(s->from);
+  s->from = NULL;
+
+  // A worker which sent something bad may still be running
+  if(error) kill(s->pid, SIGKILL);
+  int status;
+  pid_t reaped = waitpid(s->pid, &status, 0);
+  s->pid = 0;
+  if(!error && (reaped < 0 || !WIFEXITED(status) || WEXITSTATUS(status))){
+    error = "Shard worker failed";
+  }
+
+  if(!error) memcpy(items + s->start, local, s->length * sizeof(size_t));
+  free(local);
+  free(seen);
+  return error;
+}
+
+static void run_round(tournament *t, size_t *items, size_t target, size_t offset,
+                      const char *worker_path, numa_layout *layout){
+  size_t n = t->size;
+
+  unsigned char *clean = seed_cuts(t, n, items);
+  size_t count;
+  shard *shards = plan_shards(clean, n, target, offset, &count);
+  free(clean);
+
+  size_t nodes = layout->count > 1 ? layout->count : 1;
+  size_t cpus = parallel_thread_count();
+
+  for(size_t k = 0; k < count; k++){
+    shard *s = shards + k;
+    size_t node = k % nodes;
+    size_t on_node = count / nodes + (node < count % nodes);
+    size_t node_cpus = layout->count > 1 ? layout->cpu_counts[node] : cpus;
+    size_t threads = node_cpus / on_node;
+    if(threads < 1) threads = 1;
+
+    FASDEBUG("Shard %lu: %lu items from %lu%s, node %lu, %lu threads\n",
+             (unsigned long)k, (unsigned long)s->length, (unsigned long)s->start,
+             k && s->clean_start ? " after a condorcet boundary" : "",
+             (unsigned long)node, (unsigned long)threads);
+
+    if(s->length < 2) continue;
+    char *error = start_worker(t, items, s, worker_path, layout, node, threads);
+    if(error) fail_round(shards, count, error);
+  }
+
+  for(size_t k = 0; k < count; k++){
+    if(shards[k].length < 2) continue;
+    char *error = collect_worker(shards + k, items);
+    if(error) fail_round(shards, count, error);
+  }
+
+  // Only the bands around seams are repaired, so that the coordinator does
+  // no more than O(n) work of its own per round after the seed
+  for(size_t k = 1; k < count; k++){
+    if(shards[k].clean_start) continue;
+    repair_seam(t, n, items, shards[k].start);
+  }
+
+  FASDEBUG("Sharded round score: %f\n", score_fas_tournament(t, n, items));
+  free(shards);
+}
+
+size_t *sharded_ordering(tournament *t, size_t wanted, const char *worker_path){
+  size_t n = t->size;
+  size_t *items = seed_ordering(t);
+
+  numa_layout layout;
+  read_numa_layout(&layout);
+
+  // A worker that dies early should be reported, not kill us with SIGPIPE
+  signal(SIGPIPE, SIG_IGN);
+
+  if(!wanted) wanted = 1;
+  size_t target = (n + wanted - 1) / wanted;
+
+  FASDEBUG("Sharding %lu items into about %lu shards over %lu NUMA nodes\n",
+           (unsigned long)n, (unsigned long)wanted, (unsigned long)(layout.count ? layout.count : 1));
+
+  // The second round puts its seams half way between the first round's
+  for(size_t round = 0; round < (wanted > 1 ? SHARD_ROUNDS : 1); round++){
+    run_round(t, items, target, round ? target / 2 : 0, worker_path, &layout);
+  }
+
+  return items;
+}
+
+void run_shard_worker(FILE *in, FILE *out, tournament_precision precision){
+  tournament *t = read_tournament(in);
+  if(precision != TOURNAMENT_DOUBLE){
+    tournament *ct = convert_tournament(t, precision);
+    del_tournament(t);
+    t = ct;
+  }
+  size_t *items = optimal_ordering(t, NULL);
+
+  uint64_t count = t->size;
+  fwrite(&count, sizeof(uint64_t), 1, out);
+  for(size_t i = 0; i < t->size; i++){
+    uint64_t x = items[i];
+    fwrite(&x, sizeof(uint64_t), 1, out);
+  }
+  fflush(out);
+
+  free(items);
+  del_tournament(t);
+}
@@ -0,0 +1,27 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "fas_tournament.h"
+
+// Sharded solving across worker processes on the local machine.
+//
+// The coordinator seeds an ordering, cuts it into shards at condorcet
+// boundaries where it can and into contiguous blocks where it can't, and
+// pipes each shard's sub-tournament (in the binary tournament format) to a
+// worker process running worker_path --worker. Workers answer with the
+// ordering of their shard as a uint64_t count followed by that many
+// uint64_t local indices. The orderings are concatenated and the seams
+// that weren't condorcet boundaries are repaired by single moves and window
+// passes over a band around each, in an optimiser of its own. The
+// coordinator never builds a margin matrix for the whole tournament, and
+// workers store their shards at the tournament's precision.
+//
+// On machines with several NUMA nodes the workers are spread across them
+// and pinned there, so each one's memory stays local.
+
+size_t *sharded_ordering(tournament *t, size_t shards, const char *worker_path);
+
+// Body of fas --worker: reads a tournament from in, stores it at the given
+// precision, and writes its ordering to out
+void run_shard_worker(FILE *in, FILE *out, tournament_precision precision);
+#endif
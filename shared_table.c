@@ -0,0 +1,82 @@
+#include "shared_table.h"
+#include <string.h>
+
+#define SEGMENT_INITIAL_LENGTH 1024
+
+static size_t segment_bytes(shared_table_segment *s){
+  return s->table->length * sizeof(ot_entry) + s->data_bytes;
+}
+
+shared_optimisation_table *shared_optimisation_table_new(size_t memory_cap){
+  shared_optimisation_table *st = malloc(sizeof(shared_optimisation_table));
+  st->segment_cap = memory_cap / SHARED_TABLE_SEGMENTS;
+
+  for(size_t i = 0; i < SHARED_TABLE_SEGMENTS; i++){
+    shared_table_segment *s = st->segments + i;
+    pthread_mutex_init(&s->lock, NULL);
+    s->table = optimisation_table_new_with_length(SEGMENT_INITIAL_LENGTH);
+    s->data_bytes = 0;
+  }
+  return st;
+}
+
+void shared_optimisation_table_del(shared_optimisation_table *st){
+  for(size_t i = 0; i < SHARED_TABLE_SEGMENTS; i++){
+    pthread_mutex_destroy(&st->segments[i].lock);
+    optimisation_table_del(st->segments[i].table);
+  }
+  free(st);
+}
+
+static shared_table_segment *segment_for(shared_optimisation_table *st, size_t length, size_t *items){
+  uint64_t h = set_hash(length, items);
+  return st->segments + (h >> (64 - SHARED_TABLE_SEGMENT_BITS));
+}
+
+int shared_optimisation_table_get(shared_optimisation_table *st, size_t length, size_t *items, double *value, size_t *best){
+  shared_table_segment *s = segment_for(st, length, items);
+  int found = 0;
+
+  pthread_mutex_lock(&s->lock);
+  size_t occupancy = s->table->occupancy;
+  ot_entry *e = optimisation_table_lookup(s->table, length, items);
+  if(s->table->occupancy != occupancy) s->data_bytes += length * sizeof(size_t);
+  if(e->value != OT_UNKNOWN){
+    *value = e->value;
+    memcpy(best, e->data, length * sizeof(size_t));
+    found = 1;
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return found;
+}
+
+void shared_optimisation_table_put(shared_optimisation_table *st, size_t length, size_t *best, double value){
+  shared_table_segment *s = segment_for(st, length, best);
+
+  pthread_mutex_lock(&s->lock);
+  if(segment_bytes(s) > st->segment_cap){
+    optimisation_table_del(s->table);
+    s->table = optimisation_table_new_with_length(SEGMENT_INITIAL_LENGTH);
+    s->data_bytes = 0;
+  }
+
+  size_t occupancy = s->table->occupancy;
+  ot_entry *e = optimisation_table_lookup(s->table, length, best);
+  if(s->table->occupancy != occupancy) s->data_bytes += length * sizeof(size_t);
+  // Threads racing on the same set all found an optimum, so any will do
+  e->value = value;
+  memcpy(e->data, best, length * sizeof(size_t));
+  pthread_mutex_unlock(&s->lock);
+}
+
+size_t shared_optimisation_table_bytes(shared_optimisation_table *st){
+  size_t total = 0;
+  for(size_t i = 0; i < SHARED_TABLE_SEGMENTS; i++){
+    shared_table_segment *s = st->segments + i;
+    pthread_mutex_lock(&s->lock);
+    total += segment_bytes(s);
+    pthread_mutex_unlock(&s->lock);
+  }
+  return total;
+}
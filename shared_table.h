@@ -0,0 +1,46 @@
+#ifndef SHARED_TABLE_H
+#define SHARED_TABLE_H
+
+#include "optimisation_table.h"
+#include <pthread.h>
+
+// A memo of table_optimise results that several threads can share, so
+// overlapping windows optimised on different threads reuse each other's
+// work.
+//
+// The table is split into segments by the top bits of the set hash. Each
+// segment is an ordinary optimisation_table behind its own lock, so
+// threads only contend when they hit the same segment, and a resize only
+// ever rehashes one segment. Entries are copied in and out under the lock
+// rather than handed out by pointer, since a resize can move them.
+//
+// Each segment gets an equal share of the memory cap. A segment that
+// outgrows its share is emptied and starts again. Windows move along, so
+// old entries are the least likely to be wanted.
+
+#define SHARED_TABLE_SEGMENT_BITS 6
+#define SHARED_TABLE_SEGMENTS (1 << SHARED_TABLE_SEGMENT_BITS)
+
+typedef struct {
+  pthread_mutex_t lock;
+  optimisation_table *table;
+  size_t data_bytes;
+} shared_table_segment;
+
+typedef struct {
+  size_t segment_cap;
+  shared_table_segment segments[SHARED_TABLE_SEGMENTS];
+} shared_optimisation_table;
+
+shared_optimisation_table *shared_optimisation_table_new(size_t memory_cap);
+void shared_optimisation_table_del(shared_optimisation_table *st);
+
+// If the best ordering of this set of items is known, copies it to best,
+// sets value to its margin score and returns 1. Otherwise returns 0.
+int shared_optimisation_table_get(shared_optimisation_table *st, size_t length, size_t *items, double *value, size_t *best);
+
+// Publishes best as the best ordering of its items
+void shared_optimisation_table_put(shared_optimisation_table *st, size_t length, size_t *best, double value);
+
+size_t shared_optimisation_table_bytes(shared_optimisation_table *st);
+#endif
@@ -3,6 +3,7 @@ from glob import glob
 import os
 import json
 import sys
+import tempfile
 from time import time
 import feedbackarcset as fas
 import numpy as np
@@ -16,11 +17,98 @@ TEST_CASES = sys.argv[1:] or glob(
 )
 TEST_CASES.sort()
 
+# Set to float or fixed16 to run the corpus against reduced precision storage
+PRECISION = os.environ.get("FAS_PRECISION", "double")
+
+# Window sizes with an exact kernel, checked against the generic
+# table_optimise on windows from the first EXACT_CHECK_ITEMS of the solved
+# ordering
+EXACT_KERNEL_SIZES = [7, 10, 11, 12, 13]
+EXACT_CHECK_ITEMS = 260
+
+
+def close(x, y):
+    return abs(x - y) <= 1e-9 * max(1.0, abs(x), abs(y))
+
+
+def check_exact_kernels(tournament, optimiser, ordering):
+    for k in EXACT_KERNEL_SIZES:
+        scores = []
+        for enabled in (True, False):
+            fas.set_exact_kernels(enabled)
+            # The memo is shared by both paths
+            optimiser.reset()
+            items = ordering.copy()
+            end = min(len(items), EXACT_CHECK_ITEMS)
+            for start in range(0, end - k + 1, k):
+                optimiser.items = items[start:start + k]
+                optimiser.table_optimise()
+            scores.append(fas.Optimisation(tournament, items).score)
+        fas.set_exact_kernels(True)
+        optimiser.reset()
+        if not close(*scores):
+            return False
+    return True
+
+
+def check_local_sort(optimiser, shuffled):
+    # The beater lists are only used on sparse tournaments, elsewhere this
+    # compares the insertion sort with itself
+    results = []
+    for sort in ("local_sort", "local_insertion_sort"):
+        optimiser.items = shuffled.copy()
+        getattr(optimiser, sort)()
+        results.append(optimiser.items)
+    return (results[0] == results[1]).all()
+
+
+def check_score_kernels(tournament, orderings):
+    for t in (tournament, tournament.convert("float")):
+        for ordering in orderings:
+            scores = []
+            for cap in ("scalar", None):
+                fas.set_score_kernels(cap)
+                scores.append(fas.Optimisation(t, ordering).score)
+            fas.set_score_kernels(os.environ.get("FAS_SIMD"))
+            if not close(*scores):
+                return False
+    return True
+
+
+def check_binary_round_trip(tournament):
+    fd, path = tempfile.mkstemp(suffix=".data")
+    os.close(fd)
+    try:
+        tournament.write_binary(path)
+        return fas.Tournament.read(path) == tournament
+    finally:
+        os.remove(path)
+
+
+def kernel_checks(tournament, ordering):
+    """
+    Checks that each fast path agrees with the slow one it replaces,
+    returning the names of those that don't.
+    """
+    shuffled = ordering[np.random.RandomState(0).permutation(len(ordering))]
+    failures = []
+    with fas.Optimiser(tournament, ordering.copy()) as optimiser:
+        if not check_exact_kernels(tournament, optimiser, ordering):
+            failures.append("exact kernels")
+        if not check_local_sort(optimiser, shuffled):
+            failures.append("beater lists")
+    if not check_score_kernels(tournament, [ordering, shuffled]):
+        failures.append("score kernels")
+    if not check_binary_round_trip(tournament):
+        failures.append("binary format")
+    return failures
+
 
 def main():
     quality_failures = []
     runtime_failures = []
     correctness_failures = []
+    kernel_failures = []
     losses = []
     runtimes = []
     failed = False
@@ -41,7 +129,13 @@ def main():
         test_name = os.path.basename(test).replace(".data", "")
         print test_name
         start = time()
-        ft = fas.Tournament.load(test).optimise()
+        tournament = fas.Tournament.load(test)
+        if PRECISION != "double":
+            ft = tournament.convert(PRECISION).optimise()
+            # Judge quality against the full precision weights
+            ft = fas.Optimisation(tournament, ft.ordering)
+        else:
+            ft = tournament.optimise()
         runtime = time() - start
         score = ft.score
 
@@ -77,7 +171,10 @@ def main():
         quality_failed = quality_lost > 3
         runtime_failed = runtime > 60
 
-        failed = failed or quality_failed or runtime_failed
+        disagreements = kernel_checks(tournament, ft.ordering)
+        kernels_failed = bool(disagreements)
+
+        failed = failed or quality_failed or runtime_failed or kernels_failed
 
         if correctness_failed:
             correctness_failures.append(test_name)
@@ -85,6 +182,10 @@ def main():
             quality_failures.append(test_name)
         if runtime_failed:
             runtime_failures.append(test_name)
+        if kernels_failed:
+            kernel_failures.append(
+                "%s (%s)" % (test_name, ", ".join(disagreements))
+            )
 
         print "  Loss:     %.2f %s" % (
             quality_lost, FAILURE if quality_failed else SUCCESS)
@@ -92,6 +193,8 @@ def main():
             runtime, FAILURE if runtime_failed else SUCCESS)
         print "  Correctness:   %s" % (
             FAILURE if correctness_failed else SUCCESS,)
+        print "  Kernels:  %s" % (
+            FAILURE if kernels_failed else SUCCESS,)
 
     def report_failures(name, failures):
         if failures:
@@ -111,6 +214,7 @@ def main():
         report_failures("Correctness", correctness_failures)
         report_failures("Performance", runtime_failures)
         report_failures("Quality", quality_failures)
+        report_failures("Kernels", kernel_failures)
         sys.exit(1)
 
 if __name__ == '__main__':
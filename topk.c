@@ -0,0 +1,103 @@
+#include "fas_optimiser.h"
+#include <string.h>
+
+// Top k orderings.
+//
+// Consumers often only look at the first few positions of a long ranking,
+// so rather than solving the whole tournament we look for a prefix (the
+// head) that contains the first k positions and that nothing after it
+// beats. Every pair across that boundary is then either agreed with or
+// tied, so an optimal ordering of the head alone is the start of an
+// optimal ordering of the whole tournament.
+//
+// Noisy tournaments rarely have such a boundary anywhere near k, so the
+// search is given up past a limit. The head is then that many items from
+// a partial kwik sort, with the items just after it moved to their best
+// positions until none of them can improve before the head is optimised.
+// That head is only a heuristic: an item further down the seeded order
+// may still belong in the top k. Either way the tail is left in its
+// seeded order.
+
+#define TOP_K_SLACK 32
+#define TOP_K_REPAIR_FACTOR 4
+#define TOP_K_REPAIR_ROUNDS 1000
+
+// Grows the head until no tail item beats any head item, or until it is
+// longer than limit. Items pulled in are moved to just after the head,
+// keeping their relative order. Every head item only needs to be checked
+// against the tail once, since the tail only ever shrinks.
+static size_t extend_head(fas_optimiser *o, size_t n, size_t *items, size_t head, size_t limit){
+  size_t checked = 0;
+  size_t *tail = o->buffer;
+
+  while(checked < head && head <= limit){
+    size_t pulled = 0;
+    size_t kept = 0;
+
+    for(size_t j = head; j < n; j++){
+      size_t x = items[j];
+      int beats = 0;
+      for(size_t i = checked; i < head; i++){
+        if(margin_compare(o, x, items[i]) < 0){
+          beats = 1;
+          break;
+        }
+      }
+      if(beats) items[head + pulled++] = x;
+      else tail[kept++] = x;
+    }
+
+    memcpy(items + head + pulled, tail, kept * sizeof(size_t));
+    checked = head;
+    head += pulled;
+  }
+
+  return head;
+}
+
+size_t *top_k_ordering(tournament *t, size_t *results, size_t k, size_t *head_size){
+  fas_optimiser *o = new_optimiser(t);
+  size_t n = t->size;
+  if(results == NULL){
+    results = integer_range(n);
+  }
+  if(k > n) k = n;
+
+  size_t limit = 4 * k + 4 * TOP_K_SLACK;
+  if(limit > n) limit = n;
+
+  partial_kwik_sort(o, n, results, limit, 0);
+  size_t head = extend_head(o, n, results, k, limit);
+  int exact = head <= limit;
+
+  if(!exact){
+    head = limit;
+    size_t prefix = TOP_K_REPAIR_FACTOR * head;
+    if(prefix > n) prefix = n;
+    // Until no item of the prefix past the head has an improving move. The
+    // cap only guards against rounding making a move and its reverse both
+    // look like improvements.
+    int changed = 1;
+    for(size_t round = 0; changed && round < TOP_K_REPAIR_ROUNDS; round++){
+      changed = 0;
+      for(size_t i = head; i < prefix; i++) changed |= best_single_move(o, prefix, results, i);
+    }
+  }
+
+  FASDEBUG("Top %lu: optimising a head of %lu out of %lu items (%s)\n",
+           (unsigned long)k, (unsigned long)head, (unsigned long)n,
+           exact ? "at a boundary" : "no boundary found");
+
+  if(head <= 15){
+    table_optimise(o, head, results);
+  } else {
+    population_optimise(o, head, results, 500, 1000);
+    comprehensive_smoothing(o, head, results);
+    window_optimise(o, head, results, 10);
+    local_sort(o, head, results);
+  }
+
+  if(head_size) *head_size = head;
+  del_optimiser(o);
+  return results;
+}